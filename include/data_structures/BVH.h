@@ -1,29 +1,98 @@
 #ifndef BVH_H
 #define BVH_H
 
+#include <stdint.h>
+#include <cassert>
+#include <utility>
 #include <vector>
 
+#include "data_structures/BVHSplit.h"
+#include "data_structures/QueryStats.h"
+#include "data_structures/TreeStats.h"
 #include "physics/Intersection.h"
 #include "physics/RigidBody.h"
 #include "geometry/BoundingBox.h"
+#include "geometry/Distance.h"
 #include "geometry/Sphere.h"
 #include "geometry/Ray.h"
 
+#define BVH_QUERY_STACK_SIZE 64
+
+typedef std::pair<RigidBody*, RigidBody*> RigidBodyPair;
+
+struct BVHBuildState;
+
 struct BVHNode {
   BoundingBox box;
   BVHNode* left;
   BVHNode* right;
+
+  // Only leaves hold objects.
   std::vector<RigidBody*> objects;
 
-  BVHNode (const std::vector<RigidBody*>& newObjects, int level=0);
+  BVHNode (const std::vector<RigidBody*>& newObjects, int level=0,
+           BVHSplitMethod method=SPLIT_SAH);
+
+  BVHNode (BVHBuildState& state, int begin, int end, int level);
+
+  void build (BVHBuildState& state, int begin, int end, int level);
 
   void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
   void getAllBoxesDebug (std::vector<BoundingBox>& allBoxes,
                          std::vector<bool>& isleft) const;
 
+  bool isLeaf () const {
+    return left == NULL || right == NULL;
+  }
+
+  // Recomputes boxes bottom-up from the objects without changing topology.
+  void refit ();
+
+  // Surface area heuristic cost relative to this node's box.
+  float getSAHCost () const;
+
+  // Node counts, histograms, SAH cost, sibling overlap and memory.
+  TreeStats getStats () const;
+
   bool getIntersection (const Sphere& obj, Intersection& isect) const;
   bool getIntersection (const Ray& ray, Intersection& isect) const;
 
+  // True as soon as any hit with tMin < t < tMax is found. Skips the
+  // closest hit bookkeeping, for shadow and visibility rays.
+  bool isOccluded (const Ray& ray, float tMin=0.0f, float tMax=INF) const;
+
+  // Runs isOccluded for every ray in parallel, one flag per ray.
+  void isOccluded (const std::vector<Ray>& rays,
+                   std::vector<uint8_t>& occluded,
+                   float tMin=0.0f, float tMax=INF) const;
+
+  // Branch and bound search for the closest object surface point, nearer
+  // child first. Only replaces nearest with something strictly closer.
+  bool getNearest (const glm::vec3& point, NearestHit& nearest) const;
+
+  // Runs getNearest for every point in parallel, one result per point.
+  void getNearest (const std::vector<glm::vec3>& points,
+                   std::vector<NearestHit>& nearest,
+                   float maxDistance=INF) const;
+
+  // Appends every pair of objects in this tree with overlapping boxes,
+  // each pair exactly once.
+  void getOverlappingPairs (std::vector<RigidBodyPair>& pairs) const;
+
+  // Appends every (ours, theirs) pair with overlapping boxes, for testing
+  // a dynamic tree against a static one.
+  void getOverlappingPairs (const BVHNode& other,
+                            std::vector<RigidBodyPair>& pairs) const;
+
+  // Calls visit(RigidBody*) for every object whose box overlaps the query.
+  // Uses a fixed size stack and never allocates.
+  template <typename Visitor>
+  QueryStats queryBox (const BoundingBox& query, Visitor visit) const;
+
+  template <typename Visitor>
+  QueryStats querySphere (const glm::vec3& center, float radius,
+                          Visitor visit) const;
+
   ~BVHNode () {
     if (left != NULL)
       delete left;
@@ -32,4 +101,70 @@ struct BVHNode {
   }
 };
 
+template <typename Visitor>
+QueryStats BVHNode::queryBox (const BoundingBox& query, Visitor visit) const {
+  QueryStats stats;
+
+  const BVHNode* stack[BVH_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+
+  while (top > 0) {
+    const BVHNode* node = stack[--top];
+
+    stats.nodeTests++;
+    if (!query.intersects(node->box))
+      continue;
+
+    if (node->isLeaf()) {
+      for (RigidBody* rigid : node->objects) {
+        stats.primitiveTests++;
+        if (query.intersects(rigid->getBoundingBox()))
+          visit(rigid);
+      }
+    }
+    else {
+      assert(top + 2 <= BVH_QUERY_STACK_SIZE);
+      stack[top++] = node->right;
+      stack[top++] = node->left;
+    }
+  }
+
+  return stats;
+}
+
+template <typename Visitor>
+QueryStats BVHNode::querySphere (const glm::vec3& center, float radius,
+                                 Visitor visit) const {
+  QueryStats stats;
+  float radius2 = radius * radius;
+
+  const BVHNode* stack[BVH_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+
+  while (top > 0) {
+    const BVHNode* node = stack[--top];
+
+    stats.nodeTests++;
+    if (node->box.getDistance2(center) > radius2)
+      continue;
+
+    if (node->isLeaf()) {
+      for (RigidBody* rigid : node->objects) {
+        stats.primitiveTests++;
+        if (rigid->getBoundingBox().getDistance2(center) <= radius2)
+          visit(rigid);
+      }
+    }
+    else {
+      assert(top + 2 <= BVH_QUERY_STACK_SIZE);
+      stack[top++] = node->right;
+      stack[top++] = node->left;
+    }
+  }
+
+  return stats;
+}
+
 #endif
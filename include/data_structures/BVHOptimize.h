@@ -0,0 +1,22 @@
+#ifndef BVHOPTIMIZE_H
+#define BVHOPTIMIZE_H
+
+#include <vector>
+
+#include "data_structures/LinearBVH.h"
+
+// Default time allowed for an optimization pass, in milliseconds.
+const double BVH_OPTIMIZE_BUDGET_MS = 50.0;
+
+// Lowers the SAH cost of a depth first node array, such as one from a
+// median split or Morton build, with local tree rotations. Each rotation
+// swaps a child with a grandchild when that shrinks the one box that
+// changes. Subtrees below a fixed depth are optimized in parallel, the
+// nodes above them serially. Passes repeat until none improves or the
+// budget runs out, then the nodes are written back in depth first order.
+// Leaves and the primitive order are left as they are. Returns the
+// number of rotations applied.
+int optimizeBVH (std::vector<LinearBVHNode>& nodes,
+                 double budgetMs=BVH_OPTIMIZE_BUDGET_MS);
+
+#endif
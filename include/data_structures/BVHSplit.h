@@ -0,0 +1,69 @@
+#ifndef BVHSPLIT_H
+#define BVHSPLIT_H
+
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "geometry/BoundingBox.h"
+
+#define SAH_BINS 16
+#define SAH_TRAVERSAL_COST 1.0f
+#define SAH_INTERSECT_COST 1.0f
+
+// Limits shared by the top down BVH builders. Nodes with fewer objects than
+// the leaf cap or at the depth cap for their split method become leaves.
+#define BVH_LEAF_CAP 5
+#define BVH_DEPTH_CAP 10
+#define BVH_SAH_DEPTH_CAP 32
+
+enum BVHSplitMethod {
+  SPLIT_MEDIAN,
+  SPLIT_SAH
+};
+
+// A split plane found by binning centroids along one axis.
+struct BVHSplit {
+  int axis;
+  int bin;
+  float cost;
+
+  // Maps a centroid coordinate on axis to its bin.
+  float offset;
+  float scale;
+
+  BVHSplit () : axis(0), bin(0), cost(INF), offset(0.0f), scale(0.0f) { }
+
+  int getBin (const glm::vec3& centroid) const {
+    int b = static_cast<int>((centroid[axis] - offset) * scale);
+    return std::max(0, std::min(b, SAH_BINS - 1));
+  }
+
+  bool isLeft (const glm::vec3& centroid) const {
+    return getBin(centroid) <= bin;
+  }
+};
+
+// Evaluates SAH_BINS bins on all three axes for the objects
+// boxes[indices[0]] ... boxes[indices[count-1]].
+// Returns false when keeping them in one leaf is cheaper than any split.
+bool findSAHSplit (const std::vector<BoundingBox>& boxes,
+                   const std::vector<glm::vec3>& centroids,
+                   const int* indices, int count, BVHSplit& split);
+
+// The partition helpers reorder indices[begin, end) in place and return
+// where the right side starts, begin or end if one side came out empty.
+int partitionSAH (std::vector<int>& indices, int begin, int end,
+                  const std::vector<glm::vec3>& centroids,
+                  const BVHSplit& split);
+
+// Objects whose box maximum on axis is below the median maximum go left.
+int partitionMedian (std::vector<int>& indices, int begin, int end,
+                     const std::vector<BoundingBox>& boxes, int axis);
+
+// Splits at the median centroid, always makes progress.
+int partitionObjectMedian (std::vector<int>& indices, int begin, int end,
+                           const std::vector<glm::vec3>& centroids, int axis);
+
+#endif
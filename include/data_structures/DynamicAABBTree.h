@@ -0,0 +1,134 @@
+#ifndef DYNAMICAABBTREE_H
+#define DYNAMICAABBTREE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVH.h"
+#include "data_structures/QueryStats.h"
+#include "geometry/BoundingBox.h"
+#include "physics/RigidBody.h"
+
+#define DYNAMIC_TREE_NULL -1
+#define DYNAMIC_TREE_STACK_SIZE 128
+
+// Amount every leaf box is grown by on each side.
+const float DYNAMIC_TREE_MARGIN = 0.1f;
+
+// Fat boxes are also stretched this many frames along the displacement.
+const float DYNAMIC_TREE_DISPLACEMENT_FACTOR = 2.0f;
+
+struct DynamicTreeNode {
+  // Enlarged box for leaves, union of the children otherwise.
+  BoundingBox box;
+  RigidBody* object;
+
+  // Next free node while on the free list.
+  int parent;
+  int left;
+  int right;
+
+  // Leaves are at height 0, free nodes at -1.
+  int height;
+
+  DynamicTreeNode () :
+    object(NULL), parent(DYNAMIC_TREE_NULL), left(DYNAMIC_TREE_NULL),
+    right(DYNAMIC_TREE_NULL), height(-1) { }
+
+  bool isLeaf () const {
+    return left == DYNAMIC_TREE_NULL;
+  }
+};
+
+// Incrementally updated BVH that persists across frames. Each object owns a
+// leaf (its proxy) with a fat box, and is only reinserted once its real box
+// leaves the fat one. Insertion picks the sibling by surface area cost and
+// rotations keep the tree balanced.
+struct DynamicAABBTree {
+  std::vector<DynamicTreeNode> nodes;
+  int root;
+  int freeList;
+  int nodeCount;
+
+  float margin;
+
+  DynamicAABBTree (float newMargin=DYNAMIC_TREE_MARGIN);
+
+  // Returns the proxy id used to move or remove the object later.
+  int insert (RigidBody* object);
+
+  void remove (int proxy);
+
+  // Reinserts the proxy if its object left the fat box. The displacement
+  // predicts motion over the next frame. Returns true if reinserted.
+  bool move (int proxy, const glm::vec3& displacement=glm::vec3(0.0f));
+
+  RigidBody* getObject (int proxy) const {
+    return nodes[proxy].object;
+  }
+
+  int getHeight () const;
+
+  // Surface area heuristic cost relative to the root box.
+  float getSAHCost () const;
+
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  // Appends every pair of objects with overlapping boxes, each pair once.
+  void getOverlappingPairs (std::vector<RigidBodyPair>& pairs) const;
+
+  // Calls visit(int proxy) for every leaf whose fat box overlaps the query.
+  template <typename Visitor>
+  QueryStats queryBox (const BoundingBox& query, Visitor visit) const;
+
+  // Internal helpers.
+  int allocateNode ();
+  void freeNode (int index);
+
+  void insertLeaf (int leaf);
+  void removeLeaf (int leaf);
+
+  // Rotates the subtree at index if its children heights differ by more
+  // than one, returns the index of the new subtree root.
+  int balance (int index);
+
+  // Fixes heights and boxes from index up to the root, balancing on the way.
+  void refitAncestors (int index);
+
+  BoundingBox getFatBox (RigidBody* object) const;
+};
+
+template <typename Visitor>
+QueryStats DynamicAABBTree::queryBox (const BoundingBox& query,
+                                      Visitor visit) const {
+  QueryStats stats;
+  if (root == DYNAMIC_TREE_NULL)
+    return stats;
+
+  int stack[DYNAMIC_TREE_STACK_SIZE];
+  int top = 0;
+  stack[top++] = root;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const DynamicTreeNode& node = nodes[index];
+
+    stats.nodeTests++;
+    if (!query.intersects(node.box))
+      continue;
+
+    if (node.isLeaf()) {
+      stats.primitiveTests++;
+      visit(index);
+    }
+    else {
+      stack[top++] = node.right;
+      stack[top++] = node.left;
+    }
+  }
+
+  return stats;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef INSTANCEBVH_H
+#define INSTANCEBVH_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVHSplit.h"
+#include "data_structures/LinearBVH.h"
+#include "data_structures/MeshBVH.h"
+#include "geometry/BoundingBox.h"
+#include "geometry/Ray.h"
+
+// One placement of a shared mesh BVH in the world.
+struct MeshInstance {
+  const MeshBVH* mesh;
+  glm::mat4 toWorld;
+  glm::mat4 toObject;
+  // World space box around the transformed mesh box.
+  BoundingBox box;
+
+  MeshInstance (const MeshBVH* newMesh, const glm::mat4& newToWorld);
+
+  void setTransform (const glm::mat4& newToWorld);
+};
+
+struct InstanceHit : MeshHit {
+  int instance;
+
+  InstanceHit () : instance(-1) { }
+};
+
+// Two level structure: every unique mesh has its own bottom level MeshBVH
+// and a small top level tree indexes the instances by world box. Rays are
+// moved into object space when they reach an instance, so memory grows
+// with unique meshes and moving an instance only needs a top level build.
+struct InstanceBVH {
+  std::vector<MeshInstance> instances;
+
+  // Top level over instance boxes, leaves index order.
+  std::vector<LinearBVHNode> nodes;
+  std::vector<int> order;
+
+  // Returns the new instance's index. Call build before querying.
+  int addInstance (const MeshBVH* mesh, const glm::mat4& toWorld);
+
+  // Moves an instance. Call build before querying.
+  void setTransform (int instance, const glm::mat4& toWorld);
+
+  // Rebuilds the top level only, the mesh BVHs are left alone.
+  void build (BVHSplitMethod method=SPLIT_SAH);
+
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  // Closest hit over all instances, times are in world space.
+  bool getIntersection (const Ray& ray, InstanceHit& hit,
+                        float tMin=0.0f, float tMax=INF) const;
+
+  bool isOccluded (const Ray& ray, float tMin=0.0f, float tMax=INF) const;
+};
+
+#endif
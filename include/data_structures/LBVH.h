@@ -0,0 +1,16 @@
+#ifndef LBVH_H
+#define LBVH_H
+
+#include <vector>
+
+#include "data_structures/LinearBVH.h"
+#include "physics/RigidBody.h"
+
+// Builds bvh with the Karras 2012 linear BVH algorithm: object centroids
+// are sorted along a 30 or 63 bit Morton curve and every internal node is
+// emitted independently, all in parallel. The result is an ordinary
+// LinearBVH so the existing queries work on it unchanged.
+void buildLBVH (const std::vector<RigidBody*>& objects, LinearBVH& bvh,
+                int mortonBits=30);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef LAZYBVH_H
+#define LAZYBVH_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVHSplit.h"
+#include "physics/Intersection.h"
+#include "physics/RigidBody.h"
+#include "geometry/BoundingBox.h"
+#include "geometry/Sphere.h"
+#include "geometry/Ray.h"
+
+// Covers indices[begin, end) of its LazyBVH. Until a query reaches it the
+// node is unexpanded and nothing below it exists. Expanding either splits
+// the range into two children or turns the node into a leaf.
+struct LazyBVHNode {
+  BoundingBox box;
+  int begin;
+  int end;
+  int level;
+
+  LazyBVHNode* left;
+  LazyBVHNode* right;
+
+  // Set last, after the children are complete, so readers that see it can
+  // use them without taking the lock.
+  std::atomic<bool> expanded;
+  std::mutex lock;
+
+  LazyBVHNode (const BoundingBox& newBox, int newBegin, int newEnd,
+               int newLevel) :
+    box(newBox), begin(newBegin), end(newEnd), level(newLevel), left(NULL),
+    right(NULL), expanded(false) { }
+
+  bool isLeaf () const {
+    return left == NULL;
+  }
+
+  ~LazyBVHNode () {
+    delete left;
+    delete right;
+  }
+};
+
+// BVH built on demand: a node is split the first time a query descends
+// into it, and the split is kept for later queries. Only boxes and
+// centroids are computed up front, so a few queries only pay for the part
+// of the scene they touch. Queries may run concurrently.
+struct LazyBVH {
+  std::vector<RigidBody*> objects;
+  std::vector<BoundingBox> boxes;
+  std::vector<glm::vec3> centroids;
+  std::vector<int> indices;
+  BVHSplitMethod method;
+
+  LazyBVHNode* root;
+  std::atomic<int> expandedCount;
+
+  LazyBVH (const std::vector<RigidBody*>& newObjects,
+           BVHSplitMethod newMethod=SPLIT_SAH);
+
+  ~LazyBVH () {
+    delete root;
+  }
+
+  bool getIntersection (const Sphere& obj, Intersection& isect);
+  bool getIntersection (const Ray& ray, Intersection& isect);
+
+  bool isOccluded (const Ray& ray, float tMin=0.0f, float tMax=INF);
+
+  // Boxes of the nodes built so far.
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  // Splits node if no query has yet, safe to call from several threads.
+  void expand (LazyBVHNode* node);
+};
+
+#endif
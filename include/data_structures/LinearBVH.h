@@ -0,0 +1,113 @@
+#ifndef LINEARBVH_H
+#define LINEARBVH_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVHSplit.h"
+#include "physics/Intersection.h"
+#include "physics/RigidBody.h"
+#include "geometry/BoundingBox.h"
+#include "geometry/Sphere.h"
+#include "geometry/Ray.h"
+#include "geometry/RayPacket.h"
+
+// Larger leaves are split by object median even when SAH prefers a leaf.
+#define LINEAR_BVH_MAX_LEAF_SIZE 255
+
+// Traversal stack of the flattened layouts. A query holds at most one
+// entry per level plus one, so builders keep trees shallower than this.
+#define LINEAR_BVH_STACK_SIZE 64
+
+// 32 byte node stored in depth first order. An interior node (count == 0)
+// is directly followed by its left child and offset is its right child.
+// A leaf covers primitives[offset ... offset + count).
+struct LinearBVHNode {
+  glm::vec3 minVals;
+  uint32_t offset;
+  glm::vec3 maxVals;
+  uint16_t count;
+  uint16_t axis;
+
+  bool isLeaf () const {
+    return count > 0;
+  }
+
+  BoundingBox getBoundingBox () const {
+    return BoundingBox(minVals, maxVals);
+  }
+
+  // Slab test, tNear is where the ray enters the box.
+  bool intersects (const Ray& ray, float tMax, float& tNear) const {
+    float tMin = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      float t1 = (minVals[i] - ray.position[i]) * ray.invDirection[i];
+      float t2 = (maxVals[i] - ray.position[i]) * ray.invDirection[i];
+      tMin = std::max(tMin, std::min(t1, t2));
+      tMax = std::min(tMax, std::max(t1, t2));
+    }
+    tNear = tMin;
+    return tMin <= tMax;
+  }
+};
+
+// Deepest level of a tree in depth first order, the root is at 0.
+int getLinearBVHDepth (const std::vector<LinearBVHNode>& nodes);
+
+// Builds a depth first node array over primitive boxes and fills
+// primitives with the order the leaves refer to.
+void buildLinearBVHNodes (const std::vector<BoundingBox>& boxes,
+                          const std::vector<glm::vec3>& centroids,
+                          BVHSplitMethod method,
+                          std::vector<LinearBVHNode>& nodes,
+                          std::vector<int>& primitives);
+
+struct LinearBVH {
+  std::vector<LinearBVHNode> nodes;
+  std::vector<int> primitives;
+  std::vector<RigidBody*> objects;
+
+  // SAH cost right after the last build, used to judge refit quality.
+  float buildSAHCost;
+
+  LinearBVH () : buildSAHCost(0.0f) { }
+
+  LinearBVH (const std::vector<RigidBody*>& newObjects,
+             BVHSplitMethod method=SPLIT_SAH);
+
+  // Recomputes node boxes bottom-up without changing topology.
+  void refit ();
+
+  float getSAHCost () const;
+
+  // Current SAH cost over the cost at build time. Grows as refits
+  // degrade the tree, rebuild once it passes a threshold.
+  float getRefitRatio () const;
+
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  bool getIntersection (const Sphere& obj, Intersection& isect) const;
+  bool getIntersection (const Ray& ray, Intersection& isect) const;
+
+  // True as soon as any hit with tMin < t < tMax is found. Skips the
+  // closest hit bookkeeping, for shadow and visibility rays.
+  bool isOccluded (const Ray& ray, float tMin=0.0f, float tMax=INF) const;
+
+  // Runs isOccluded for every ray in parallel, one flag per ray.
+  void isOccluded (const std::vector<Ray>& rays,
+                   std::vector<uint8_t>& occluded,
+                   float tMin=0.0f, float tMax=INF) const;
+
+  // Traces all rays of a coherent packet together, isects holds one entry
+  // per ray. Returns the number of rays that hit something.
+  int getIntersection (const RayPacket& packet, Intersection* isects) const;
+
+  // Traces rays in packets of RAY_PACKET_SIZE consecutive rays.
+  void getIntersections (const std::vector<Ray>& rays,
+                         std::vector<Intersection>& isects) const;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef LINEAROCTREE_H
+#define LINEAROCTREE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "physics/RigidBody.h"
+#include "geometry/BoundingBox.h"
+
+// Locational codes are a 1 sentinel bit followed by 3 Morton bits per
+// level, so 21 levels fit in 64 bits and the root is 1.
+#define LINEAR_OCTREE_MAX_LEVEL 21
+#define LINEAR_OCTREE_ROOT 1ull
+
+const int LINEAR_OCTREE_LEAF_CAP = 5;
+const int LINEAR_OCTREE_DEPTH_CAP = 10;
+
+// A leaf of the octree and the objects it holds, objects[begin, end).
+struct LinearOctreeCell {
+  uint64_t key;
+  int begin;
+  int end;
+};
+
+// Pointerless octree: objects are sorted by the Morton code of their
+// position and every non empty leaf is one entry in a Morton ordered
+// array. Parents, children and neighbours are found by key arithmetic
+// and a binary search, so a rebuild is one sort and no allocation per
+// node. Every object lands in exactly one leaf.
+struct LinearOctree {
+  // Uniform cube around all positions.
+  BoundingBox box;
+  int depthCap;
+
+  // Sorted by code, codes are at depthCap levels.
+  std::vector<RigidBody*> objects;
+  std::vector<uint64_t> codes;
+
+  std::vector<LinearOctreeCell> cells;
+
+  LinearOctree (const std::vector<RigidBody*>& newObjects,
+                BoundingBox bbox=BoundingBox(),
+                int newDepthCap=LINEAR_OCTREE_DEPTH_CAP,
+                int leafCap=LINEAR_OCTREE_LEAF_CAP);
+
+  static int getLevel (uint64_t key);
+
+  static uint64_t getParent (uint64_t key) {
+    return key >> 3;
+  }
+
+  static uint64_t getChild (uint64_t key, int octant) {
+    return (key << 3) | octant;
+  }
+
+  // Cell of the same level offset by (dx, dy, dz) cells, 0 if that falls
+  // outside the root.
+  static uint64_t getNeighbor (uint64_t key, int dx, int dy, int dz);
+
+  // Key of the level cell holding point.
+  uint64_t getKey (const glm::vec3& point, int level) const;
+
+  BoundingBox getBoundingBox (uint64_t key) const;
+
+  // Leaves inside the cell key as a range [first, last) of cells. A key
+  // below the leaves gives the single leaf around it.
+  void findCells (uint64_t key, int& first, int& last) const;
+
+  // Leaf holding point, or -1 if that part of space is empty.
+  int findCell (const glm::vec3& point) const;
+
+  // Leaves and all their ancestors.
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  // Internal helpers.
+  uint64_t getStart (uint64_t key) const;
+  void subdivide (uint64_t key, int level, int begin, int end, int leafCap);
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef LOOSEOCTREE_H
+#define LOOSEOCTREE_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVH.h"
+#include "data_structures/LinearOctree.h"
+#include "data_structures/QueryStats.h"
+#include "geometry/BoundingBox.h"
+#include "physics/RigidBody.h"
+
+#define LOOSE_OCTREE_NULL -1
+#define LOOSE_OCTREE_STACK_SIZE 256
+
+// Cells are grown to this many times their size, so an object up to
+// (LOOSE_OCTREE_LOOSENESS - 1) cells wide fits in the cell of its centre.
+const float LOOSE_OCTREE_LOOSENESS = 2.0f;
+const int LOOSE_OCTREE_DEPTH_CAP = 8;
+
+struct LooseOctreeCell {
+  // Objects stored in this cell.
+  std::vector<int> proxies;
+
+  // Objects in this cell and below, the cell is dropped once it hits 0.
+  int count;
+  uint8_t childMask;
+
+  LooseOctreeCell () : count(0), childMask(0) { }
+};
+
+struct LooseOctreeProxy {
+  // NULL while on the free list.
+  RigidBody* object;
+  uint64_t cell;
+
+  // Index into the cell's proxies, next free proxy while on the free list.
+  int slot;
+};
+
+// Octree that persists across frames. Every object lives in exactly one
+// cell, the deepest one whose loose box still holds it, so objects that
+// straddle cell boundaries are neither duplicated nor missed. Cells are
+// kept in a hash map under the same locational codes as LinearOctree and
+// only objects that changed cells touch the tree when it is updated.
+struct LooseOctree {
+  // Uniform cube, objects with centres outside it are kept at the root.
+  BoundingBox box;
+  float looseness;
+  int depthCap;
+
+  std::unordered_map<uint64_t, LooseOctreeCell> cells;
+  std::vector<LooseOctreeProxy> proxies;
+  int freeList;
+
+  LooseOctree (BoundingBox bbox, float newLooseness=LOOSE_OCTREE_LOOSENESS,
+               int newDepthCap=LOOSE_OCTREE_DEPTH_CAP);
+
+  // Returns the proxy id used to move or remove the object later.
+  int insert (RigidBody* object);
+
+  void remove (int proxy);
+
+  // Moves the proxy to the cell matching where its object is now. Returns
+  // true if it changed cells.
+  bool move (int proxy);
+
+  // Moves every proxy, returns how many changed cells.
+  int update ();
+
+  RigidBody* getObject (int proxy) const {
+    return proxies[proxy].object;
+  }
+
+  // Cell an object belongs in given its centre and size.
+  uint64_t getCellKey (RigidBody* object) const;
+
+  // Cell grown by the looseness factor.
+  BoundingBox getLooseBox (uint64_t key) const;
+
+  // Loose boxes of every cell in use.
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  // Appends every pair of objects with overlapping boxes, each pair once.
+  void getOverlappingPairs (std::vector<RigidBodyPair>& pairs) const;
+
+  // Calls visit(int proxy) for every object whose box overlaps the query.
+  template <typename Visitor>
+  QueryStats queryBox (const BoundingBox& query, Visitor visit) const;
+
+  // Internal helpers.
+  void addToCell (int proxy, uint64_t key);
+  void removeFromCell (int proxy);
+};
+
+template <typename Visitor>
+QueryStats LooseOctree::queryBox (const BoundingBox& query,
+                                  Visitor visit) const {
+  QueryStats stats;
+  if (cells.empty())
+    return stats;
+
+  uint64_t stack[LOOSE_OCTREE_STACK_SIZE];
+  int top = 0;
+  stack[top++] = LINEAR_OCTREE_ROOT;
+
+  while (top > 0) {
+    uint64_t key = stack[--top];
+    const LooseOctreeCell& cell = cells.find(key)->second;
+
+    // The root also holds everything outside the tree, so is never culled.
+    stats.nodeTests++;
+    if (key != LINEAR_OCTREE_ROOT && !query.intersects(getLooseBox(key)))
+      continue;
+
+    for (int proxy : cell.proxies) {
+      stats.primitiveTests++;
+      if (query.intersects(proxies[proxy].object->getBoundingBox()))
+        visit(proxy);
+    }
+
+    for (int i = 0; i < 8; i++) {
+      if (cell.childMask & (1 << i))
+        stack[top++] = LinearOctree::getChild(key, i);
+    }
+  }
+
+  return stats;
+}
+
+#endif
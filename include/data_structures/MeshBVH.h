@@ -0,0 +1,110 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVHSplit.h"
+#include "data_structures/LinearBVH.h"
+#include "geometry/BoundingBox.h"
+#include "geometry/Distance.h"
+#include "geometry/Ray.h"
+
+// Bump when the cache layout or the build algorithm changes.
+#define MESH_BVH_CACHE_VERSION 2
+
+// Hits closer than this along a ray, relative to their distance from the
+// ray origin but never under one unit, can count as one when deduplicating.
+#define MESH_HIT_EPSILON 1e-5f
+// Barycentric weights below this put a hit on an edge or vertex.
+#define MESH_EDGE_EPSILON 1e-4f
+
+struct MeshHit {
+  int face;
+  float timeHit;
+  // Barycentric coordinates of the hit relative to the second and third
+  // vertex of the face.
+  float u, v;
+  bool hit;
+
+  MeshHit () : face(-1), hit(false) { }
+};
+
+// BVH over the triangles of an indexed mesh, as produced by LoadOBJ. Leaves
+// refer to faces by index so no per triangle objects are allocated.
+struct MeshBVH {
+  std::vector<LinearBVHNode> nodes;
+  // Face indices in leaf order.
+  std::vector<int> triangles;
+  std::vector<glm::vec3> vertices;
+  std::vector<glm::uvec3> faces;
+
+  MeshBVH () { }
+
+  MeshBVH (const std::vector<glm::vec4>& meshVertices,
+           const std::vector<glm::uvec3>& meshFaces,
+           BVHSplitMethod method=SPLIT_SAH);
+
+  // Loads the tree from cachePath if it was built from the same mesh and
+  // parameters, otherwise builds it and rewrites the cache.
+  MeshBVH (const std::vector<glm::vec4>& meshVertices,
+           const std::vector<glm::uvec3>& meshFaces,
+           const std::string& cachePath,
+           BVHSplitMethod method=SPLIT_SAH);
+
+  // Builds nodes and triangle order from vertices and faces.
+  void build (BVHSplitMethod method);
+
+  // Writes nodes and triangle order to a versioned binary file.
+  bool save (const std::string& path, uint64_t key) const;
+
+  // Maps a file written by save and copies the arrays out. Fails if the
+  // version or key do not match. Vertices and faces are not stored.
+  bool load (const std::string& path, uint64_t key);
+
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  // Closest triangle hit with tMin < t < tMax.
+  bool getIntersection (const Ray& ray, MeshHit& hit,
+                        float tMin=0.0f, float tMax=INF) const;
+
+  // Appends every hit with tMin < t < tMax to hits and returns how many
+  // were added. Deduplicating sorts as well and drops repeated hits where
+  // the ray crosses an edge or vertex shared by the faces. Separate faces
+  // that happen to be hit at the same distance are all kept.
+  int getAllIntersections (const Ray& ray, std::vector<MeshHit>& hits,
+                           bool sorted=true, bool dedupe=false,
+                           float tMin=0.0f, float tMax=INF) const;
+
+  // True as soon as any hit with tMin < t < tMax is found. Skips the
+  // closest hit bookkeeping, for shadow and visibility rays.
+  bool isOccluded (const Ray& ray, float tMin=0.0f, float tMax=INF) const;
+
+  // Runs isOccluded for every ray in parallel, one flag per ray.
+  void isOccluded (const std::vector<Ray>& rays,
+                   std::vector<uint8_t>& occluded,
+                   float tMin=0.0f, float tMax=INF) const;
+
+  // Closest point on the mesh surface, nearest.primitive is the face.
+  // Only replaces nearest with something strictly closer.
+  bool getNearest (const glm::vec3& point, NearestHit& nearest) const;
+
+  // Runs getNearest for every point in parallel, one result per point.
+  void getNearest (const std::vector<glm::vec3>& points,
+                   std::vector<NearestHit>& nearest,
+                   float maxDistance=INF) const;
+
+  // Moller-Trumbore test against a single face.
+  bool intersectsFace (const Ray& ray, int face, float tMin, float tMax,
+                       MeshHit& hit) const;
+};
+
+// FNV-1a hash of the mesh buffers and build parameters, the cache key.
+uint64_t getMeshBVHKey (const std::vector<glm::vec4>& meshVertices,
+                        const std::vector<glm::uvec3>& meshFaces,
+                        BVHSplitMethod method);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef QUANTIZEDBVH_H
+#define QUANTIZEDBVH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/MeshBVH.h"
+#include "geometry/BoundingBox.h"
+#include "geometry/Ray.h"
+
+// A child reference is either an interior node index or, with the high
+// bit set, a leaf packed as a 23 bit triangle offset and an 8 bit count,
+// which limits meshes to QUANTIZED_MAX_OFFSET triangles.
+#define QUANTIZED_LEAF_BIT 0x80000000u
+#define QUANTIZED_COUNT_BITS 8
+#define QUANTIZED_MAX_OFFSET ((1u << 23) - 1)
+
+// Interior node holding both children's boxes as T sized offsets into the
+// box of the node itself. Boxes are rounded outwards so they only grow.
+template <typename T>
+struct QuantizedBVHNode {
+  T childMin[2][3];
+  T childMax[2][3];
+  uint32_t child[2];
+};
+
+// Compressed copy of a MeshBVH. Leaves disappear into their parents'
+// child references, so only interior nodes are stored. Triangles and the
+// leaf order still come from the source MeshBVH, which must outlive this.
+template <typename T>
+struct QuantizedBVH {
+  std::vector<QuantizedBVHNode<T> > nodes;
+  const MeshBVH* mesh;
+
+  BoundingBox rootBox;
+  uint32_t root;
+
+  QuantizedBVH (const MeshBVH& source);
+
+  // Bytes used by the nodes and the root box.
+  size_t getMemoryUsage () const;
+
+  // Decoded boxes, which contain the exact ones.
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  // Closest triangle hit with tMin < t < tMax.
+  bool getIntersection (const Ray& ray, MeshHit& hit,
+                        float tMin=0.0f, float tMax=INF) const;
+};
+
+typedef QuantizedBVH<uint8_t> QuantizedBVH8;
+typedef QuantizedBVH<uint16_t> QuantizedBVH16;
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+// Work done by a single query, for profiling.
+struct QueryStats {
+  int nodeTests;
+  int primitiveTests;
+
+  QueryStats () : nodeTests(0), primitiveTests(0) { }
+};
+
+#endif
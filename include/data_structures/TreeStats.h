@@ -0,0 +1,42 @@
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "geometry/BoundingBox.h"
+
+// Quality figures for a spatial tree, gathered one node at a time.
+struct TreeStats {
+  int nodeCount;
+  int leafCount;
+  // Objects held by leaves. Both trees store each object in exactly one
+  // leaf, so this matches the object count.
+  int objectCount;
+  int maxDepth;
+
+  // Nodes per depth and leaves per number of objects held.
+  std::vector<int> depthHistogram;
+  std::vector<int> occupancyHistogram;
+
+  // Surface area heuristic cost relative to the root box.
+  float sahCost;
+  // Volume shared by sibling boxes, summed over all pairs of siblings.
+  float overlapVolume;
+  size_t memoryBytes;
+
+  TreeStats ();
+
+  void addNode (int depth, const BoundingBox& box, bool isLeaf, int objects,
+                size_t bytes);
+
+  void addSiblings (const BoundingBox& a, const BoundingBox& b);
+
+  // Normalizes the SAH cost once every node has been added.
+  void finish (const BoundingBox& root);
+
+  std::string toJSON () const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "data_structures/LinearBVH.h"
+#include "physics/Intersection.h"
+#include "physics/RigidBody.h"
+#include "geometry/BoundingBox.h"
+#include "geometry/Sphere.h"
+#include "geometry/Ray.h"
+
+// N children per node with their bounds in structure of arrays form so a
+// ray or sphere is tested against all of them at once. A slot with
+// count > 0 is a leaf over primitives[child ... child + count), count == 0
+// and child >= 0 is an interior node, child == -1 is an empty slot.
+template <int N>
+struct WideBVHNode {
+  float minX[N];
+  float minY[N];
+  float minZ[N];
+  float maxX[N];
+  float maxY[N];
+  float maxZ[N];
+  int32_t child[N];
+  uint16_t count[N];
+
+  WideBVHNode () {
+    for (int i = 0; i < N; ++i) {
+      minX[i] = minY[i] = minZ[i] = INF;
+      maxX[i] = maxY[i] = maxZ[i] = -INF;
+      child[i] = -1;
+      count[i] = 0;
+    }
+  }
+
+  void setBoundingBox (int i, const BoundingBox& box) {
+    minX[i] = box.minVals.x;
+    minY[i] = box.minVals.y;
+    minZ[i] = box.minVals.z;
+    maxX[i] = box.maxVals.x;
+    maxY[i] = box.maxVals.y;
+    maxZ[i] = box.maxVals.z;
+  }
+
+  BoundingBox getBoundingBox (int i) const {
+    return BoundingBox(glm::vec3(minX[i], minY[i], minZ[i]),
+                       glm::vec3(maxX[i], maxY[i], maxZ[i]));
+  }
+};
+
+// BVH4 / BVH8 made by collapsing the binary LinearBVH, which removes every
+// other level and the box loads that go with it.
+template <int N>
+struct WideBVH {
+  std::vector<WideBVHNode<N> > nodes;
+  std::vector<int> primitives;
+  std::vector<RigidBody*> objects;
+
+  WideBVH (const LinearBVH& bvh);
+
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
+  bool getIntersection (const Sphere& obj, Intersection& isect) const;
+  bool getIntersection (const Ray& ray, Intersection& isect) const;
+};
+
+typedef WideBVH<4> BVH4;
+typedef WideBVH<8> BVH8;
+
+#endif
@@ -1,25 +1,103 @@
 #ifndef OCTREE_H
 #define OCTREE_H
 
+#include <cassert>
+#include <utility>
 #include <vector>
 
+#include <glm/glm.hpp>
+
+#include "data_structures/QueryStats.h"
+#include "data_structures/TreeStats.h"
 #include "physics/RigidBody.h"
 #include "geometry/BoundingBox.h"
 #include "geometry/Sphere.h"
 #include "geometry/Geometry.h"
 
+#define OCTREE_QUERY_STACK_SIZE 128
+
+// Neighbour query results as (squared distance, object) pairs. Keep one per
+// thread and reuse it so queries stop allocating once it has grown.
+struct NeighborBuffer {
+  std::vector<std::pair<float, RigidBody*> > results;
+};
+
+// Totals over a group of objects, for Barnes-Hut style approximations.
+struct OctreeAggregate {
+  int count;
+  float mass;
+
+  // Mass weighted mean position.
+  glm::vec3 centroid;
+  glm::vec3 velocitySum;
+
+  OctreeAggregate () : count(0), mass(0.0f), centroid(), velocitySum() { }
+
+  OctreeAggregate (const RigidBody* object) :
+    count(1), mass(object->mass), centroid(object->position),
+    velocitySum(object->velocity) { }
+};
+
 struct OctTreeNode {
   BoundingBox box;
   OctTreeNode* cells[8];
   std::vector<RigidBody*> objects;
 
+  // Totals over every object in this subtree, filled in by the build.
+  OctreeAggregate aggregate;
+
   OctTreeNode (const std::vector<RigidBody*>& newObjects,
                int level=0, BoundingBox bbox=BoundingBox());
 
   std::vector<const OctTreeNode*> getAllNodes () const;
 
+  void getAllBoxes (std::vector<BoundingBox>& allBoxes) const;
+
   bool isLeaf () const;
 
+  // Node counts, histograms, SAH cost, sibling overlap and memory. Nodes
+  // without cells count as leaves.
+  TreeStats getStats () const;
+
+  // Calls visit(RigidBody*) for every object whose position lies in the
+  // query, matching how objects are sorted into cells. Uses a fixed size
+  // stack and never allocates.
+  template <typename Visitor>
+  QueryStats queryBox (const BoundingBox& query, Visitor visit) const;
+
+  template <typename Visitor>
+  QueryStats querySphere (const glm::vec3& center, float radius,
+                          Visitor visit) const;
+
+  // Up to k objects nearest to point, nearest first, skipping exclude.
+  // Cells are visited nearest first and a bounded max heap holds the best
+  // so far, so cells farther than the kth object are never opened. Each
+  // object is reported once since the build stores it in one cell only.
+  // Returns the number found.
+  int getNearestNeighbors (const glm::vec3& point, int k,
+                           NeighborBuffer& buffer,
+                           const RigidBody* exclude=NULL) const;
+
+  // All objects within radius of center, skipping exclude, in no
+  // particular order. Each object is reported once, as above. Returns the
+  // number found.
+  int getNeighborsInRadius (const glm::vec3& center, float radius,
+                            NeighborBuffer& buffer,
+                            const RigidBody* exclude=NULL) const;
+
+  // Barnes-Hut walk around point. A node is passed whole to
+  // visit(const OctreeAggregate&) when its width over the distance from
+  // point to its centroid is below theta, otherwise it is opened. Nodes
+  // containing point are always opened and objects of opened leaves are
+  // passed one at a time, skipping exclude. A theta of 0 visits every
+  // object, larger values trade accuracy for fewer visits.
+  template <typename Visitor>
+  QueryStats queryBarnesHut (const glm::vec3& point, float theta,
+                             const RigidBody* exclude, Visitor visit) const;
+
+  // Internal helpers.
+  void sumAggregate ();
+
   ~OctTreeNode () {
     for (int i = 0; i < 8; ++i) {
       if (cells[i] != NULL)
@@ -28,4 +106,113 @@ struct OctTreeNode {
   }
 };
 
+template <typename Visitor>
+QueryStats OctTreeNode::queryBox (const BoundingBox& query, Visitor visit) const {
+  QueryStats stats;
+
+  const OctTreeNode* stack[OCTREE_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+
+  while (top > 0) {
+    const OctTreeNode* node = stack[--top];
+
+    stats.nodeTests++;
+    if (!query.intersects(node->box))
+      continue;
+
+    for (RigidBody* object : node->objects) {
+      stats.primitiveTests++;
+      if (query.intersects(object->position))
+        visit(object);
+    }
+
+    assert(top + 8 <= OCTREE_QUERY_STACK_SIZE);
+    for (int i = 0; i < 8; i++) {
+      if (node->cells[i] != NULL)
+        stack[top++] = node->cells[i];
+    }
+  }
+
+  return stats;
+}
+
+template <typename Visitor>
+QueryStats OctTreeNode::querySphere (const glm::vec3& center, float radius,
+                                     Visitor visit) const {
+  QueryStats stats;
+  float radius2 = radius * radius;
+
+  const OctTreeNode* stack[OCTREE_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+
+  while (top > 0) {
+    const OctTreeNode* node = stack[--top];
+
+    stats.nodeTests++;
+    if (node->box.getDistance2(center) > radius2)
+      continue;
+
+    for (RigidBody* object : node->objects) {
+      stats.primitiveTests++;
+      glm::vec3 d = object->position - center;
+      if (glm::dot(d, d) <= radius2)
+        visit(object);
+    }
+
+    assert(top + 8 <= OCTREE_QUERY_STACK_SIZE);
+    for (int i = 0; i < 8; i++) {
+      if (node->cells[i] != NULL)
+        stack[top++] = node->cells[i];
+    }
+  }
+
+  return stats;
+}
+
+template <typename Visitor>
+QueryStats OctTreeNode::queryBarnesHut (const glm::vec3& point, float theta,
+                                        const RigidBody* exclude,
+                                        Visitor visit) const {
+  QueryStats stats;
+  float theta2 = theta * theta;
+
+  const OctTreeNode* stack[OCTREE_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+
+  while (top > 0) {
+    const OctTreeNode* node = stack[--top];
+
+    stats.nodeTests++;
+    if (node->aggregate.count == 0)
+      continue;
+
+    // Compare squared width with theta squared times squared distance.
+    if (!node->box.intersects(point)) {
+      float width = node->box.maxVals[0] - node->box.minVals[0];
+      glm::vec3 d = node->aggregate.centroid - point;
+      if (width * width < theta2 * glm::dot(d, d)) {
+        visit(node->aggregate);
+        continue;
+      }
+    }
+
+    for (RigidBody* object : node->objects) {
+      stats.primitiveTests++;
+      if (object != exclude)
+        visit(OctreeAggregate(object));
+    }
+
+    assert(top + 8 <= OCTREE_QUERY_STACK_SIZE);
+    for (int i = 0; i < 8; i++) {
+      if (node->cells[i] != NULL)
+        stack[top++] = node->cells[i];
+    }
+  }
+
+  return stats;
+}
+
 #endif
@@ -19,7 +19,7 @@ struct BoundingBox {
   glm::vec3 maxVals;
 
   BoundingBox (const std::vector<glm::vec4>& points=std::vector<glm::vec4>()) :
-    isEmpty(points.size() > 0), minVals(INF, INF, INF), maxVals(-INF, -INF, -INF) {
+    isEmpty(points.size() == 0), minVals(INF, INF, INF), maxVals(-INF, -INF, -INF) {
     add(points);
   }
 
@@ -34,9 +34,19 @@ struct BoundingBox {
 
   float getSurfaceArea () const;
 
+  glm::vec3 getCenter () const;
+
+  int getLongestAxis () const;
+
+  // Squared distance from point to the box, zero inside.
+  float getDistance2 (const glm::vec3& point) const;
+
   std::vector<glm::vec4> getVertices () const;
   std::vector<glm::uvec2> getEdges () const;
 
+  // True if rhs lies entirely inside this box.
+  bool contains (const BoundingBox& rhs) const;
+
   bool intersects (const BoundingBox &rhs) const;
   bool intersects (const glm::vec3& point) const;
   bool intersects (const Ray& r, Intersection& isect) const;
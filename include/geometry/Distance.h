@@ -0,0 +1,31 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <glm/glm.hpp>
+
+#include "geometry/BoundingBox.h"
+
+struct RigidBody;
+
+// Result of a nearest primitive query. Set distance2 before the query to
+// limit the search radius.
+struct NearestHit {
+  glm::vec3 point;
+  float distance2;
+
+  // Face index for meshes, object for trees of rigid bodies.
+  int primitive;
+  RigidBody* object;
+
+  bool hit;
+
+  NearestHit (float maxDistance=INF) :
+    distance2(maxDistance * maxDistance), primitive(-1), object(NULL),
+    hit(false) { }
+};
+
+// Closest point to p on triangle abc, including its interior.
+glm::vec3 closestPointOnTriangle (const glm::vec3& p, const glm::vec3& a,
+                                  const glm::vec3& b, const glm::vec3& c);
+
+#endif
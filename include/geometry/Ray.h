@@ -7,9 +7,10 @@
 struct Ray {
   glm::vec3 position;
   glm::vec3 direction;
+  glm::vec3 invDirection;
 
   Ray(const glm::vec3 &o, const glm::vec3 &v) :
-    position(o), direction(glm::normalize(v)) { }
+    position(o), direction(glm::normalize(v)), invDirection(1.0f / direction) { }
 };
 
 #endif
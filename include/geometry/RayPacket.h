@@ -0,0 +1,39 @@
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "geometry/Ray.h"
+
+#define RAY_PACKET_SIZE 8
+
+// Up to RAY_PACKET_SIZE rays in structure of arrays form so one SIMD
+// instruction can slab test all of them against a box.
+struct RayPacket {
+  const Ray* rays;
+  int count;
+
+  alignas(32) float originX[RAY_PACKET_SIZE];
+  alignas(32) float originY[RAY_PACKET_SIZE];
+  alignas(32) float originZ[RAY_PACKET_SIZE];
+  alignas(32) float invDirX[RAY_PACKET_SIZE];
+  alignas(32) float invDirY[RAY_PACKET_SIZE];
+  alignas(32) float invDirZ[RAY_PACKET_SIZE];
+
+  RayPacket (const Ray* r, int n) : rays(r), count(std::min(n, RAY_PACKET_SIZE)) {
+    for (int i = 0; i < RAY_PACKET_SIZE; ++i) {
+      // Unused lanes repeat the first ray and are masked out.
+      const Ray& ray = rays[(i < count) ? i : 0];
+      originX[i] = ray.position.x;
+      originY[i] = ray.position.y;
+      originZ[i] = ray.position.z;
+      invDirX[i] = ray.invDirection.x;
+      invDirY[i] = ray.invDirection.y;
+      invDirZ[i] = ray.invDirection.z;
+    }
+  }
+};
+
+#endif
@@ -29,20 +29,12 @@ struct Sphere : RigidBody {
   }
 
   virtual BoundingBox getBoundingBox () const {
-    std::vector<glm::vec4> points;
-
-    points.push_back(glm::vec4(position.x - radius, position.y, position.z, 1.0));
-    points.push_back(glm::vec4(position.x + radius, position.y, position.z, 1.0));
-
-    points.push_back(glm::vec4(position.x, position.y - radius, position.z, 1.0));
-    points.push_back(glm::vec4(position.x, position.y + radius, position.z, 1.0));
-
-    points.push_back(glm::vec4(position.x, position.y, position.z - radius, 1.0));
-    points.push_back(glm::vec4(position.x, position.y, position.z + radius, 1.0));
-
-    return BoundingBox(points);
+    glm::vec3 extent(radius, radius, radius);
+    return BoundingBox(position - extent, position + extent);
   }
 
+  virtual glm::vec3 closestPoint (const glm::vec3& p) const;
+
   bool intersects (const Sphere& other, Intersection& isect) const;
   bool intersects (const Plane& other, Intersection& isect) const;
   bool intersects (const BoundingBox& other, Intersection& isect) const;
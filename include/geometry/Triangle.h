@@ -24,6 +24,8 @@ struct Triangle : RigidBody {
 
   virtual BoundingBox getBoundingBox () const;
 
+  virtual glm::vec3 closestPoint (const glm::vec3& p) const;
+
   virtual bool intersects (const Ray& ray, Intersection& isect) const;
 };
 
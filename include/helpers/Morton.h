@@ -0,0 +1,24 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Interleaves the bits of a point in the unit cube, x in the highest bit.
+// 30 bit codes use 10 bits per axis, 63 bit codes use 21 bits per axis.
+uint32_t getMortonCode30 (const glm::vec3& unitPoint);
+uint64_t getMortonCode63 (const glm::vec3& unitPoint);
+
+// Integer cell coordinates, up to 21 bits per axis, to and from the same
+// interleaving as getMortonCode63.
+uint64_t encodeMorton63 (const glm::uvec3& cell);
+glm::uvec3 decodeMorton63 (uint64_t code);
+
+// Stable LSD radix sort of keys carrying values along, 8 bits per pass.
+// Only the low keyBits bits of each key are looked at.
+void parallelRadixSort (std::vector<uint64_t>& keys,
+                        std::vector<int>& values, int keyBits);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Smallest amount of work worth handing to another thread.
+const int PARALLEL_GRAIN = 1024;
+
+inline int getNumThreads () {
+  int n = std::thread::hardware_concurrency();
+  return std::max(n, 1);
+}
+
+inline int getNumChunks (int count) {
+  return std::max(1, std::min(getNumThreads(), count / PARALLEL_GRAIN));
+}
+
+// Levels at the top of a tree with the given number of children per node
+// that are worth building on separate threads, enough for every core to
+// get a subtree without spawning far more threads than cores.
+inline int getParallelDepth (int branching) {
+  int depth = 0;
+  for (long long width = 1; width < getNumThreads(); width *= branching)
+    depth++;
+  return depth;
+}
+
+// Splits [begin, end) into numChunks contiguous ranges and calls
+// f(chunk, chunkBegin, chunkEnd) for each on its own thread.
+// The calling thread runs chunk 0.
+template <typename F>
+void parallelForChunks (int numChunks, int begin, int end, F f) {
+  int count = end - begin;
+  std::vector<std::thread> threads;
+  for (int c = 1; c < numChunks; ++c) {
+    int b = begin + static_cast<long long>(count) * c / numChunks;
+    int e = begin + static_cast<long long>(count) * (c + 1) / numChunks;
+    threads.push_back(std::thread(f, c, b, e));
+  }
+  f(0, begin, begin + static_cast<long long>(count) / numChunks);
+  for (std::thread& t : threads)
+    t.join();
+}
+
+// Calls f(i) for every i in [begin, end) spread over all cores.
+template <typename F>
+void parallelFor (int begin, int end, F f) {
+  parallelForChunks(getNumChunks(end - begin), begin, end,
+                    [&f](int, int b, int e) {
+    for (int i = b; i < e; ++i)
+      f(i);
+  });
+}
+
+#endif
@@ -49,6 +49,13 @@ struct RigidBody {
 
   virtual BoundingBox getBoundingBox () const = 0;
 
+  // Closest point on the surface to p. Defaults to the bounding box, which
+  // is never further away than the real surface.
+  virtual glm::vec3 closestPoint (const glm::vec3& p) const {
+    BoundingBox box = getBoundingBox();
+    return glm::clamp(p, box.minVals, box.maxVals);
+  }
+
   // TODO: make this pure virtual, need to implement intersects for all rigid bodies.
   virtual bool intersects (const Ray& ray, Intersection& isect) const {
     return false;
@@ -13,7 +13,8 @@
 
 #include "helpers/RandomUtils.h"
 
-#include "data_structures/octree.h"
+#include "data_structures/DynamicAABBTree.h"
+#include "data_structures/LooseOctree.h"
 
 #include "geometry/Plane.h"
 #include "geometry/Sphere.h"
@@ -47,6 +48,14 @@ WireProgram wireP(&view_matrix, &projection_matrix);
 vector<Sphere*> objects;
 vector<Plane> planes;
 vector<RigidBody*> object_pointers;
+map<RigidBody*, int> object_index;
+
+// Broad phase, one proxy per sphere.
+DynamicAABBTree tree;
+vector<int> proxies;
+
+// Wireframe view, updated in place instead of rebuilt on every draw.
+LooseOctree octree(BoundingBox(minB, maxB));
 
 vector<glm::vec4> sphere_vertices;
 vector<glm::uvec3> sphere_faces;
@@ -75,7 +84,10 @@ void balls () {
 
         objects.push_back(tmp);
 
+        object_index[tmp] = object_pointers.size();
         object_pointers.push_back((RigidBody*)objects.back());
+        proxies.push_back(tree.insert(tmp));
+        octree.insert(tmp);
       }
     }
   }
@@ -104,6 +116,8 @@ void balls () {
   milliseconds ms = chrono::duration_cast<milliseconds>(t1 - t0);
   milliseconds dt = chrono::duration_cast<milliseconds>(t1 - start);
 
+  vector<RigidBodyPair> pairs;
+
   while (keepLoopingOpenGL()) {
     lineP.drawAxis();
 
@@ -128,14 +142,21 @@ void balls () {
 
             }
           }
+        }
 
-          for (int j = 0; j < objects.size(); ++j) {
-            if (i == j)
-              continue;
-            if (objects[i]->intersects(*objects[j], isects[i])) {
+        // Broad phase, only spheres that left their fat boxes are
+        // reinserted and only spheres with overlapping boxes get tested.
+        for (int i = 0; i < objects.size(); ++i)
+          tree.move(proxies[i], DT * objects[i]->velocity);
 
-            }
-          }
+        pairs.clear();
+        tree.getOverlappingPairs(pairs);
+
+        for (const RigidBodyPair& pair : pairs) {
+          int i = object_index[pair.first];
+          int j = object_index[pair.second];
+          objects[i]->intersects(*objects[j], isects[i]);
+          objects[j]->intersects(*objects[i], isects[j]);
         }
 
         for (int i = 0; i < objects.size(); ++i) {
@@ -167,11 +188,11 @@ void balls () {
         }
 
         if (showWire) {
-          OctTreeNode root(object_pointers, BoundingBox(minB, maxB));
+          octree.update();
 
           vector<BoundingBox> octtreeBoxes;
 
-          root.getAllBoxes(octtreeBoxes);
+          octree.getAllBoxes(octtreeBoxes);
 
           for (BoundingBox& box: octtreeBoxes) {
             vector<glm::vec4> vertices = box.getVertices();
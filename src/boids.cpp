@@ -11,9 +11,11 @@
 #include <glm/glm.hpp>
 
 #include "data_structures/BVH.h"
+#include "data_structures/LinearOctree.h"
 #include "data_structures/octree.h"
 #include "geometry/Plane.h"
 #include "geometry/Sphere.h"
+#include "helpers/Parallel.h"
 #include "helpers/RandomUtils.h"
 #include "physics/Intersection.h"
 #include "render/Floor.h"
@@ -30,6 +32,12 @@ using namespace std;
 
 const bool SHOW_BVH = false;
 
+// Rebuild the refitted BVH once its SAH cost grows by this factor.
+const float BVH_REBUILD_RATIO = 1.5f;
+
+// Boids follow at most this many nearest flockmates.
+const int MAX_NEIGHBORS = 32;
+
 float BOUNDS = 2.5f;
 glm::vec3 minB(-BOUNDS, -BOUNDS, -BOUNDS);
 glm::vec3 maxB(BOUNDS, BOUNDS, BOUNDS);
@@ -87,6 +95,16 @@ void boids () {
     }
   }
 
+  float maxRadius = 0.0f;
+  for (Sphere* object : objects)
+    maxRadius = max(maxRadius, static_cast<float>(object->radius));
+
+  BVHNode* bvh = NULL;
+  float bvhBuildCost = 0.0f;
+
+  // Neighbour query results, one buffer per thread reused every frame.
+  vector<NeighborBuffer> buffers(getNumThreads());
+
   while (keepLoopingOpenGL()) {
     lineP.drawAxis();
 
@@ -106,40 +124,60 @@ void boids () {
       objects[r]->velocity.z += ((rand() % 11) - 5) * 0.01f;
     }
 
-    vector<glm::vec3> changeV;
+    // Neighbours come from an octree built once per frame instead of
+    // sorting every other boid for each one.
+    OctTreeNode flock(object_pointers);
+    int numNeighbors = min<int>(objects.size() / 10, MAX_NEIGHBORS);
+
+    vector<glm::vec3> avgVs(objects.size());
+    vector<glm::vec3> avgPs(objects.size());
+    vector<glm::vec3> getAways(objects.size());
+
+    parallelForChunks(getNumChunks(objects.size()), 0, objects.size(),
+                      [&](int chunk, int begin, int end) {
+      NeighborBuffer& buffer = buffers[chunk];
+
+      for (int i = begin; i < end; ++i) {
+        Sphere* self = objects[i];
+
+        // Boids closer than the sum of radii times 3.5, in squared units.
+        float awayRadius = sqrt((self->radius + maxRadius) * 3.5f);
+        flock.getNeighborsInRadius(self->position, awayRadius, buffer, self);
+        for (const pair<float, RigidBody*>& neighbor : buffer.results) {
+          Sphere* other = static_cast<Sphere*>(neighbor.second);
+          if (neighbor.first < (self->radius + other->radius) * 3.5f)
+            getAways[i] += glm::normalize(self->position - other->position);
+        }
 
-    for (int i = 0; i < objects.size(); ++i) {
-      glm::vec3 centerMass;
-      glm::vec3 getAway;
-
-      multimap<float, Sphere*> distMap;
-
-      for (int j = 0; j < objects.size(); ++j) {
-        if (i == j)
-          continue;
-        centerMass += objects[j]->position;
-        float dist = glm::length2(objects[j]->position - objects[i]->position);
-        if (dist < (objects[i]->radius + objects[j]->radius) * 3.5f)
-          getAway += glm::normalize(objects[i]->position - objects[j]->position);
-        distMap.insert(pair<float, Sphere*>(dist, objects[j]));
+        int found = flock.getNearestNeighbors(self->position, numNeighbors,
+                                              buffer, self);
+        for (const pair<float, RigidBody*>& neighbor : buffer.results) {
+          avgVs[i] += neighbor.second->velocity;
+          avgPs[i] += neighbor.second->position;
+        }
+
+        if (found > 0) {
+          avgVs[i] /= static_cast<float>(found);
+          avgPs[i] /= static_cast<float>(found);
+        }
       }
+    });
 
-      centerMass /= (objects.size() - 1);
+    // Exact sum over the flock once per frame, each boid takes itself out.
+    glm::vec3 positionSum;
+    for (int i = 0; i < objects.size(); ++i)
+      positionSum += objects[i]->position;
 
-      int numNeighbors = objects.size() / 10;
-      glm::vec3 avgV;
-      glm::vec3 avgP;
+    vector<glm::vec3> changeV;
 
-      int num = 0;
-      for (auto neighbor: distMap) {
-        if (++num > numNeighbors)
-          break;
-        avgV += neighbor.second->velocity;
-        avgP += neighbor.second->position;
-      }
+    for (int i = 0; i < objects.size(); ++i) {
+      glm::vec3 centerMass = positionSum - objects[i]->position;
+      glm::vec3 getAway = getAways[i];
 
-      avgV /= static_cast<float>(numNeighbors);
-      avgP /= static_cast<float>(numNeighbors);
+      centerMass /= (objects.size() - 1);
+
+      glm::vec3 avgV = avgVs[i];
+      glm::vec3 avgP = avgPs[i];
 
       glm::vec3 dV1 = avgP - objects[i]->position;
       glm::vec3 dV2 = centerMass - objects[i]->position;
@@ -159,7 +197,7 @@ void boids () {
     }
 
     if (showWire && !SHOW_BVH) {
-      OctTreeNode root(object_pointers, BoundingBox(5.0f * minB, 5.0f * maxB));
+      LinearOctree root(object_pointers, BoundingBox(5.0f * minB, 5.0f * maxB));
 
       vector<BoundingBox> octtreeBoxes;
 
@@ -178,12 +216,19 @@ void boids () {
     }
 
     if (showWire && SHOW_BVH) {
-      BVHNode root(object_pointers);
+      if (bvh != NULL)
+        bvh->refit();
+
+      if (bvh == NULL || bvh->getSAHCost() > BVH_REBUILD_RATIO * bvhBuildCost) {
+        delete bvh;
+        bvh = new BVHNode(object_pointers);
+        bvhBuildCost = bvh->getSAHCost();
+      }
 
       vector<BoundingBox> bvhboxes;
       vector<bool> isleft;
 
-      root.getAllBoxesDebug(bvhboxes, isleft);
+      bvh->getAllBoxesDebug(bvhboxes, isleft);
 
       for (int i = 0; i < bvhboxes.size(); ++i) {
         if (isleft[i])
@@ -219,6 +264,8 @@ void boids () {
 
     endLoopOpenGL();
   }
+
+  delete bvh;
 }
 
 int main (int argc, char* argv[]) {
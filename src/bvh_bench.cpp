@@ -0,0 +1,165 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVH.h"
+#include "data_structures/MeshBVH.h"
+#include "data_structures/QuantizedBVH.h"
+#include "data_structures/octree.h"
+#include "geometry/Ray.h"
+#include "geometry/Sphere.h"
+#include "helpers/RandomUtils.h"
+
+using namespace std;
+using namespace glm;
+
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::milliseconds milliseconds;
+
+// Rays shot at the dragon when comparing node layouts.
+const int REPORT_RAYS = 100000;
+
+const float SPHERE_SIZE = 0.002f;
+
+// Octree cells narrower than BARNES_HUT_THETA times their distance are
+// summed as one group, the field is softened so close pairs stay finite.
+const float BARNES_HUT_THETA = 0.5f;
+const float BARNES_HUT_SOFTENING = 1e-4f;
+const int BARNES_HUT_POINTS = 2000;
+
+vector<vec4> dragon_vertices;
+vector<uvec3> dragon_faces;
+vector<vec4> dragon_normals;
+
+// Times closest hit queries for every ray, in milliseconds.
+template <typename BVH>
+long long timeRays (const BVH& tree, const vector<Ray>& rays, int& hits) {
+  hits = 0;
+  Clock::time_point t0 = Clock::now();
+  for (const Ray& ray : rays) {
+    MeshHit hit;
+    hits += tree.getIntersection(ray, hit);
+  }
+  return chrono::duration_cast<milliseconds>(Clock::now() - t0).count();
+}
+
+void reportQuantizedBVH (const MeshBVH& dragon_bvh) {
+  if (dragon_bvh.nodes.empty())
+    return;
+
+  QuantizedBVH8 bvh8(dragon_bvh);
+  QuantizedBVH16 bvh16(dragon_bvh);
+
+  // Rays from above the dragon towards random points in its box.
+  BoundingBox box = dragon_bvh.nodes[0].getBoundingBox();
+  vec3 extent = box.maxVals - box.minVals;
+  vector<Ray> rays;
+  for (int i = 0; i < REPORT_RAYS; ++i) {
+    vec3 from(rand() / float(RAND_MAX), 2.0f, rand() / float(RAND_MAX));
+    vec3 to(rand() / float(RAND_MAX), rand() / float(RAND_MAX),
+            rand() / float(RAND_MAX));
+    from = box.minVals + from * extent;
+    to = box.minVals + to * extent;
+    rays.push_back(Ray(from, to - from));
+  }
+
+  int hits;
+  size_t bytes = dragon_bvh.nodes.size() * sizeof(LinearBVHNode);
+  long long ms = timeRays(dragon_bvh, rays, hits);
+  cout << "MeshBVH: " << bytes << " bytes, " << ms << " ms, "
+       << hits << " hits." << endl;
+
+  ms = timeRays(bvh16, rays, hits);
+  cout << "QuantizedBVH16: " << bvh16.getMemoryUsage() << " bytes, "
+       << ms << " ms, " << hits << " hits." << endl;
+
+  ms = timeRays(bvh8, rays, hits);
+  cout << "QuantizedBVH8: " << bvh8.getMemoryUsage() << " bytes, "
+       << ms << " ms, " << hits << " hits." << endl;
+}
+
+// Shape of both object trees over one sphere per dragon vertex.
+void reportTreeStats () {
+  vector<RigidBody*> spheres;
+  for (const vec4& vertex : dragon_vertices)
+    spheres.push_back(new Sphere(SPHERE_SIZE, vec3(vertex)));
+
+  OctTreeNode octree(spheres);
+  cout << "Octree stats: " << octree.getStats().toJSON() << endl;
+
+  BVHNode bvh(spheres);
+  cout << "BVH stats: " << bvh.getStats().toJSON() << endl;
+
+  for (RigidBody* sphere : spheres)
+    delete sphere;
+}
+
+// Inverse square pull on self from everything the walk visits.
+vec3 getField (const OctTreeNode& octree, const RigidBody* self, float theta) {
+  vec3 field;
+  octree.queryBarnesHut(self->position, theta, self,
+                        [&](const OctreeAggregate& group) {
+    vec3 d = group.centroid - self->position;
+    float dist2 = dot(d, d) + BARNES_HUT_SOFTENING;
+    field += group.mass * d / (dist2 * sqrt(dist2));
+  });
+  return field;
+}
+
+// Barnes-Hut against the exact sum, which theta 0 gives, on a sample of
+// the dragon vertex spheres.
+void reportBarnesHut () {
+  vector<RigidBody*> spheres;
+  for (const vec4& vertex : dragon_vertices)
+    spheres.push_back(new Sphere(SPHERE_SIZE, vec3(vertex)));
+
+  if (spheres.empty())
+    return;
+
+  OctTreeNode octree(spheres);
+
+  vector<const RigidBody*> sample;
+  for (int i = 0; i < BARNES_HUT_POINTS; ++i)
+    sample.push_back(spheres[rand() % spheres.size()]);
+
+  vector<vec3> exact;
+  Clock::time_point t0 = Clock::now();
+  for (const RigidBody* self : sample)
+    exact.push_back(getField(octree, self, 0.0f));
+  long long exactMs =
+    chrono::duration_cast<milliseconds>(Clock::now() - t0).count();
+
+  float error = 0.0f;
+  t0 = Clock::now();
+  for (int i = 0; i < sample.size(); ++i) {
+    vec3 field = getField(octree, sample[i], BARNES_HUT_THETA);
+    error += length(field - exact[i]) / length(exact[i]);
+  }
+  long long ms =
+    chrono::duration_cast<milliseconds>(Clock::now() - t0).count();
+
+  cout << "Barnes-Hut theta " << BARNES_HUT_THETA << ": " << ms
+       << " ms against " << exactMs << " ms exact, mean relative error "
+       << error / sample.size() << "." << endl;
+
+  for (RigidBody* sphere : spheres)
+    delete sphere;
+}
+
+int main (int argc, char* argv[]) {
+  LoadOBJ("./obj/dragon.obj", dragon_vertices, dragon_faces, dragon_normals);
+
+  // Reuses the tree from the previous run when the mesh is unchanged.
+  Clock::time_point t0 = Clock::now();
+  MeshBVH dragon_bvh(dragon_vertices, dragon_faces, "./obj/dragon.bvh");
+  milliseconds ms = chrono::duration_cast<milliseconds>(Clock::now() - t0);
+  cout << "Dragon BVH ready in " << ms.count() << " ms." << endl;
+
+  reportQuantizedBVH(dragon_bvh);
+  reportTreeStats();
+  reportBarnesHut();
+}
@@ -1,57 +1,157 @@
+#include <thread>
 #include <vector>
 
 #include "data_structures/BVH.h"
+#include "data_structures/BVHSplit.h"
+#include "helpers/Parallel.h"
 #include "geometry/Sphere.h"
 #include "physics/Intersection.h"
 #include "physics/RigidBody.h"
 
-#define LEAF_CAP 5
-#define DEPTH_CAP 10
+#define PARALLEL_BUILD_CUTOFF 4096
 #define NEW_FEATURE 0
 
 using namespace std;
 using namespace glm;
 
-BVHNode::BVHNode (const vector<RigidBody*>& objects_, int level) :
-  objects(objects_), left(NULL), right(NULL) {
-  vector<BoundingBox> objectBoxes;
-  vector<BoundingBox> objectBoxesOriginal;
-  for (int i = 0; i < objects.size(); ++i) {
-    objectBoxes.push_back(objects[i]->getBoundingBox());
-    box.merge(objectBoxes[i]);
+// Shared by every node of one build. Nodes partition disjoint ranges of
+// indices in place, so subtrees can be built on separate threads.
+struct BVHBuildState {
+  const vector<RigidBody*>& objects;
+  vector<BoundingBox> boxes;
+  vector<vec3> centroids;
+  vector<int> indices;
+  BVHSplitMethod method;
+
+  // Nodes above this level may build a subtree on another thread.
+  int parallelLevel;
+
+  BVHBuildState (const vector<RigidBody*>& o, BVHSplitMethod m) :
+    objects(o), method(m), parallelLevel(0) { }
+};
+
+BVHNode::BVHNode (const vector<RigidBody*>& objects_, int level,
+                  BVHSplitMethod method) :
+  left(NULL), right(NULL) {
+  BVHBuildState state(objects_, method);
+
+  int n = objects_.size();
+  state.boxes.resize(n);
+  state.centroids.resize(n);
+  state.indices.resize(n);
+  state.parallelLevel = level + getParallelDepth(2);
+
+  parallelFor(0, n, [&](int i) {
+    state.boxes[i] = objects_[i]->getBoundingBox();
+    state.centroids[i] = state.boxes[i].getCenter();
+    state.indices[i] = i;
+  });
+
+  build(state, 0, n, level);
+}
+
+BVHNode::BVHNode (BVHBuildState& state, int begin, int end, int level) :
+  left(NULL), right(NULL) {
+  build(state, begin, end, level);
+}
+
+void BVHNode::build (BVHBuildState& state, int begin, int end, int level) {
+  for (int i = begin; i < end; ++i)
+    box.merge(state.boxes[state.indices[i]]);
+
+  int count = end - begin;
+  int depthCap = (state.method == SPLIT_SAH) ? BVH_SAH_DEPTH_CAP
+                                              : BVH_DEPTH_CAP;
+  int mid = begin;
+
+  if (count >= BVH_LEAF_CAP && level < depthCap) {
+    if (state.method == SPLIT_SAH) {
+      // Stays a leaf if that is cheaper than any split.
+      BVHSplit split;
+      if (findSAHSplit(state.boxes, state.centroids, &state.indices[begin], count, split))
+        mid = partitionSAH(state.indices, begin, end, state.centroids, split);
+    }
+    else {
+      mid = partitionMedian(state.indices, begin, end, state.boxes,
+                            box.getLongestAxis());
+    }
   }
-  objectBoxesOriginal = objectBoxes;
 
-  if (objects.size() < LEAF_CAP || level >= DEPTH_CAP)
+  if (mid == begin || mid == end) {
+    for (int i = begin; i < end; ++i)
+      objects.push_back(state.objects[state.indices[i]]);
     return;
+  }
 
-  int axis = 0;
-  for (int i = 1; i < 3; ++i) {
-    if (box.maxVals[i] - box.minVals[i] > box.maxVals[axis] - box.minVals[axis])
-      axis = i;
+  // Large subtrees near the top build the left half on another thread.
+  if (count > PARALLEL_BUILD_CUTOFF && level < state.parallelLevel) {
+    thread leftThread([&]() {
+      left = new BVHNode(state, begin, mid, level + 1);
+    });
+    right = new BVHNode(state, mid, end, level + 1);
+    leftThread.join();
+  }
+  else {
+    left = new BVHNode(state, begin, mid, level + 1);
+    right = new BVHNode(state, mid, end, level + 1);
   }
+}
 
-  auto comp = [&](const BoundingBox& lhs, const BoundingBox& rhs)-> bool {
-    return lhs.maxVals[axis] < rhs.maxVals[axis];
-  };
-  sort(objectBoxes.begin(), objectBoxes.end(), comp);
+void BVHNode::refit () {
+  box = BoundingBox();
 
-  float threshold = objectBoxes[objectBoxes.size() / 2].maxVals[axis];
+  if (left == NULL || right == NULL) {
+    for (RigidBody* rigid : objects)
+      box.merge(rigid->getBoundingBox());
+    return;
+  }
 
-  vector<RigidBody*> leftObjects;
-  vector<RigidBody*> rightObjects;
+  left->refit();
+  right->refit();
 
-  for (int i = 0; i < objects.size(); ++i) {
-    if (objectBoxesOriginal[i].maxVals[axis] < threshold)
-      leftObjects.push_back(objects[i]);
-    else
-      rightObjects.push_back(objects[i]);
-  }
+  box.merge(left->box);
+  box.merge(right->box);
+}
 
-  if (leftObjects.size() > 0 && rightObjects.size() > 0) {
-    left = new BVHNode(leftObjects, level+1);
-    right = new BVHNode(rightObjects, level+1);
-  }
+namespace {
+
+float getSAHCostRecursive (const BVHNode* node) {
+  float area = node->box.getSurfaceArea();
+  if (node->left == NULL || node->right == NULL)
+    return area * SAH_INTERSECT_COST * node->objects.size();
+  return area * SAH_TRAVERSAL_COST +
+         getSAHCostRecursive(node->left) + getSAHCostRecursive(node->right);
+}
+
+} // End anonymous namespace for SAH cost helper.
+
+float BVHNode::getSAHCost () const {
+  float area = box.getSurfaceArea();
+  if (area <= 0.0f)
+    return 0.0f;
+  return getSAHCostRecursive(this) / area;
+}
+
+namespace {
+
+void addStats (const BVHNode* node, int depth, TreeStats& stats) {
+  size_t bytes = sizeof(BVHNode) + node->objects.capacity() * sizeof(RigidBody*);
+  stats.addNode(depth, node->box, node->isLeaf(), node->objects.size(), bytes);
+  if (node->isLeaf())
+    return;
+
+  stats.addSiblings(node->left->box, node->right->box);
+  addStats(node->left, depth + 1, stats);
+  addStats(node->right, depth + 1, stats);
+}
+
+} // End anonymous namespace for statistics helper.
+
+TreeStats BVHNode::getStats () const {
+  TreeStats stats;
+  addStats(this, 0, stats);
+  stats.finish(box);
+  return stats;
 }
 
 void BVHNode::getAllBoxes (vector<BoundingBox>& allBoxes) const {
@@ -75,11 +175,181 @@ void BVHNode::getAllBoxesDebug (vector<BoundingBox>& allBoxes, vector<bool>& isl
   }
 }
 
+namespace {
+
+void getLeafPairs (const BVHNode* a, const BVHNode* b, vector<RigidBodyPair>& pairs) {
+  for (RigidBody* rigidA : a->objects) {
+    BoundingBox boxA = rigidA->getBoundingBox();
+    for (RigidBody* rigidB : b->objects) {
+      if (boxA.intersects(rigidB->getBoundingBox()))
+        pairs.push_back(RigidBodyPair(rigidA, rigidB));
+    }
+  }
+}
+
+// Simultaneous descent of two subtrees, splitting the larger one first.
+void getPairs (const BVHNode* a, const BVHNode* b, vector<RigidBodyPair>& pairs) {
+  if (!a->box.intersects(b->box))
+    return;
+
+  if (a->isLeaf() && b->isLeaf()) {
+    getLeafPairs(a, b, pairs);
+  }
+  else if (b->isLeaf() ||
+           (!a->isLeaf() && a->box.getSurfaceArea() > b->box.getSurfaceArea())) {
+    getPairs(a->left, b, pairs);
+    getPairs(a->right, b, pairs);
+  }
+  else {
+    getPairs(a, b->left, pairs);
+    getPairs(a, b->right, pairs);
+  }
+}
+
+void getSelfPairs (const BVHNode* node, vector<RigidBodyPair>& pairs) {
+  if (node->isLeaf()) {
+    for (int i = 0; i < node->objects.size(); ++i) {
+      BoundingBox box = node->objects[i]->getBoundingBox();
+      for (int j = i + 1; j < node->objects.size(); ++j) {
+        if (box.intersects(node->objects[j]->getBoundingBox()))
+          pairs.push_back(RigidBodyPair(node->objects[i], node->objects[j]));
+      }
+    }
+    return;
+  }
+
+  getSelfPairs(node->left, pairs);
+  getSelfPairs(node->right, pairs);
+  getPairs(node->left, node->right, pairs);
+}
+
+} // End anonymous namespace for overlap helpers.
+
+void BVHNode::getOverlappingPairs (vector<RigidBodyPair>& pairs) const {
+  getSelfPairs(this, pairs);
+}
+
+void BVHNode::getOverlappingPairs (const BVHNode& other,
+                                   vector<RigidBodyPair>& pairs) const {
+  getPairs(this, &other, pairs);
+}
+
+bool BVHNode::isOccluded (const Ray& ray, float tMin, float tMax) const {
+  const BVHNode* stack[BVH_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = this;
+
+  while (top > 0) {
+    const BVHNode* node = stack[--top];
+
+    Intersection boxIsect;
+    if (!node->box.intersects(ray, boxIsect) || boxIsect.timeHit > tMax)
+      continue;
+
+    if (node->isLeaf()) {
+      for (RigidBody* rigid : node->objects) {
+        Intersection rigidIsect;
+        if (rigid->intersects(ray, rigidIsect) &&
+            rigidIsect.timeHit > tMin && rigidIsect.timeHit < tMax)
+          return true;
+      }
+    }
+    else {
+      assert(top + 2 <= BVH_QUERY_STACK_SIZE);
+      stack[top++] = node->right;
+      stack[top++] = node->left;
+    }
+  }
+
+  return false;
+}
+
+void BVHNode::isOccluded (const vector<Ray>& rays, vector<uint8_t>& occluded,
+                          float tMin, float tMax) const {
+  occluded.resize(rays.size());
+  parallelFor(0, rays.size(), [&](int i) {
+    occluded[i] = isOccluded(rays[i], tMin, tMax);
+  });
+}
+
+bool BVHNode::getNearest (const vec3& point, NearestHit& nearest) const {
+  struct Entry {
+    const BVHNode* node;
+    float distance2;
+  };
+
+  Entry stack[BVH_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = { this, box.getDistance2(point) };
+
+  bool result = false;
+
+  while (top > 0) {
+    Entry entry = stack[--top];
+
+    // The search radius may have shrunk since this was pushed.
+    if (entry.distance2 >= nearest.distance2)
+      continue;
+
+    const BVHNode* node = entry.node;
+    if (node->isLeaf()) {
+      for (RigidBody* rigid : node->objects) {
+        vec3 closest = rigid->closestPoint(point);
+        vec3 offset = closest - point;
+        float distance2 = dot(offset, offset);
+        if (distance2 < nearest.distance2) {
+          nearest.point = closest;
+          nearest.distance2 = distance2;
+          nearest.object = rigid;
+          nearest.hit = true;
+          result = true;
+        }
+      }
+      continue;
+    }
+
+    Entry near = { node->left, node->left->box.getDistance2(point) };
+    Entry far = { node->right, node->right->box.getDistance2(point) };
+    if (far.distance2 < near.distance2)
+      std::swap(near, far);
+
+    assert(top + 2 <= BVH_QUERY_STACK_SIZE);
+    if (far.distance2 < nearest.distance2)
+      stack[top++] = far;
+    if (near.distance2 < nearest.distance2)
+      stack[top++] = near;
+  }
+
+  return result;
+}
+
+void BVHNode::getNearest (const vector<vec3>& points,
+                          vector<NearestHit>& nearest,
+                          float maxDistance) const {
+  nearest.assign(points.size(), NearestHit(maxDistance));
+  parallelFor(0, points.size(), [&](int i) {
+    getNearest(points[i], nearest[i]);
+  });
+}
+
 #ifdef NEW_FEATURE
 bool BVHNode::getIntersection (const Sphere& obj, Intersection& isect) const {
   Intersection tmp;
   if (obj.intersects(box, tmp) == false)
     return false;
+
+  if (isLeaf()) {
+    for (RigidBody* rigid : objects) {
+      if (rigid == &obj)
+        continue;
+      if (obj.intersects(rigid->getBoundingBox(), tmp)) {
+        isect.hit = true;
+        return true;
+      }
+    }
+    return false;
+  }
+
   return left->getIntersection(obj, isect) || right->getIntersection(obj, isect);
 }
 
@@ -88,6 +358,10 @@ bool BVHNode::getIntersection (const Ray& ray, Intersection& isect) const {
   if (box.intersects(ray, tmp) == false)
     return false;
 
+  // Nothing in this box can beat the closest hit found so far.
+  if (isect.hit && tmp.timeHit > isect.timeHit)
+    return false;
+
   bool result = false;
 
   if (left == NULL || right == NULL) {
@@ -100,15 +374,16 @@ bool BVHNode::getIntersection (const Ray& ray, Intersection& isect) const {
       }
     }
   }
+  // Visit the child closer along the ray first so the far one can be culled.
+  else if (dot(right->box.getCenter() - left->box.getCenter(), ray.direction) < 0.0f) {
+    result |= right->getIntersection(ray, isect);
+    result |= left->getIntersection(ray, isect);
+  }
   else {
-    if (left != NULL)
-      result |= left->getIntersection(ray, isect);
-    if (right != NULL)
-      result |= right->getIntersection(ray, isect);
+    result |= left->getIntersection(ray, isect);
+    result |= right->getIntersection(ray, isect);
   }
 
-  cout << result << endl;
-
   return result;
 }
 #endif
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVHOptimize.h"
+#include "helpers/Parallel.h"
+
+// Subtrees rooted at this depth are optimized independently.
+#define TREELET_DEPTH 6
+#define MAX_PASSES 16
+// Rotations must shrink the changed box by this fraction of its parent.
+#define MIN_IMPROVEMENT 1e-4f
+
+using namespace std;
+using namespace glm;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+namespace {
+
+// Tree with explicit child links over the original node ids. Rotations
+// only relink interior nodes, every node keeps its id and leaves stay put.
+// Heights are levels below a node, refreshed on the way up each pass.
+struct OptimizeState {
+  const vector<LinearBVHNode>& nodes;
+  vector<int> left;
+  vector<int> right;
+  vector<int> heights;
+  vector<BoundingBox> boxes;
+  Clock::time_point deadline;
+
+  OptimizeState (const vector<LinearBVHNode>& n) : nodes(n) { }
+
+  bool isLeaf (int index) const {
+    return nodes[index].isLeaf();
+  }
+
+  bool isExpired () const {
+    return Clock::now() > deadline;
+  }
+};
+
+float getUnionArea (const BoundingBox& a, const BoundingBox& b) {
+  BoundingBox box = a;
+  box.merge(b);
+  return box.getSurfaceArea();
+}
+
+void updateHeight (OptimizeState& state, int index) {
+  state.heights[index] = 1 + std::max(state.heights[state.left[index]],
+                                      state.heights[state.right[index]]);
+}
+
+// Whether the tree stays within the traversal stacks when the node at
+// depth takes given from its child and hands that child moved, which
+// then sits next to kept.
+bool fitsStack (const OptimizeState& state, int depth, int moved, int kept,
+                int given) {
+  int child = 1 + std::max(state.heights[moved], state.heights[kept]);
+  int height = 1 + std::max(state.heights[given], child);
+  return depth + height < LINEAR_BVH_STACK_SIZE;
+}
+
+// Tries the four child / grandchild swaps at index and applies the one
+// that shrinks the affected child box the most. A subtree swap leaves the
+// node's own box and every other box unchanged. Swaps that would push
+// leaves past the traversal stack depth are skipped.
+bool rotate (OptimizeState& state, int index, int depth) {
+  int a = state.left[index];
+  int b = state.right[index];
+
+  float best = -MIN_IMPROVEMENT * state.boxes[index].getSurfaceArea();
+  int choice = -1;
+
+  if (!state.isLeaf(b)) {
+    float area = state.boxes[b].getSurfaceArea();
+    int c = state.left[b];
+    int d = state.right[b];
+    float swapC = getUnionArea(state.boxes[a], state.boxes[d]) - area;
+    float swapD = getUnionArea(state.boxes[a], state.boxes[c]) - area;
+    if (swapC < best && fitsStack(state, depth, a, d, c)) {
+      best = swapC;
+      choice = 0;
+    }
+    if (swapD < best && fitsStack(state, depth, a, c, d)) {
+      best = swapD;
+      choice = 1;
+    }
+  }
+
+  if (!state.isLeaf(a)) {
+    float area = state.boxes[a].getSurfaceArea();
+    int e = state.left[a];
+    int f = state.right[a];
+    float swapE = getUnionArea(state.boxes[b], state.boxes[f]) - area;
+    float swapF = getUnionArea(state.boxes[b], state.boxes[e]) - area;
+    if (swapE < best && fitsStack(state, depth, b, f, e)) {
+      best = swapE;
+      choice = 2;
+    }
+    if (swapF < best && fitsStack(state, depth, b, e, f)) {
+      best = swapF;
+      choice = 3;
+    }
+  }
+
+  if (choice < 0)
+    return false;
+
+  // The child that gets a new sibling, and the grandchild it gives away.
+  int parent = (choice < 2) ? b : a;
+  int other = (choice < 2) ? a : b;
+  bool giveLeft = (choice == 0 || choice == 2);
+  int& slot = giveLeft ? state.left[parent] : state.right[parent];
+  int given = slot;
+
+  slot = other;
+  if (choice < 2)
+    state.left[index] = given;
+  else
+    state.right[index] = given;
+
+  BoundingBox box = state.boxes[state.left[parent]];
+  box.merge(state.boxes[state.right[parent]]);
+  state.boxes[parent] = box;
+
+  updateHeight(state, parent);
+  updateHeight(state, index);
+  return true;
+}
+
+int optimizeSubtree (OptimizeState& state, int index, int depth) {
+  if (state.isLeaf(index))
+    return 0;
+  int rotations = optimizeSubtree(state, state.left[index], depth + 1);
+  rotations += optimizeSubtree(state, state.right[index], depth + 1);
+  updateHeight(state, index);
+  return rotations + rotate(state, index, depth);
+}
+
+// Post order over the nodes above TREELET_DEPTH, collecting the roots
+// below them when treelets is given and rotating otherwise.
+int optimizeTop (OptimizeState& state, int index, int depth,
+                 vector<int>* treelets) {
+  if (state.isLeaf(index))
+    return 0;
+
+  if (depth == TREELET_DEPTH) {
+    if (treelets != NULL)
+      treelets->push_back(index);
+    return 0;
+  }
+
+  int rotations = optimizeTop(state, state.left[index], depth + 1, treelets);
+  rotations += optimizeTop(state, state.right[index], depth + 1, treelets);
+  if (treelets == NULL) {
+    updateHeight(state, index);
+    rotations += rotate(state, index, depth);
+  }
+  return rotations;
+}
+
+// Writes the subtree at index in depth first order, putting the child
+// with the lower centre along the axis that separates them best on the
+// left so near first traversal keeps working.
+void emit (const OptimizeState& state, int index,
+           vector<LinearBVHNode>& result) {
+  int position = result.size();
+  result.push_back(state.nodes[index]);
+  if (state.isLeaf(index))
+    return;
+
+  int l = state.left[index];
+  int r = state.right[index];
+  vec3 between = state.boxes[r].getCenter() - state.boxes[l].getCenter();
+  int axis = 0;
+  for (int i = 1; i < 3; ++i) {
+    if (std::abs(between[i]) > std::abs(between[axis]))
+      axis = i;
+  }
+  if (between[axis] < 0.0f)
+    std::swap(l, r);
+
+  LinearBVHNode& node = result[position];
+  node.minVals = state.boxes[index].minVals;
+  node.maxVals = state.boxes[index].maxVals;
+  node.axis = axis;
+
+  emit(state, l, result);
+  result[position].offset = result.size();
+  emit(state, r, result);
+}
+
+} // End anonymous namespace for tree rotation helpers.
+
+int optimizeBVH (vector<LinearBVHNode>& nodes, double budgetMs) {
+  if (nodes.size() < 3)
+    return 0;
+
+  OptimizeState state(nodes);
+  state.deadline = Clock::now() +
+    chrono::duration_cast<Clock::duration>(
+      chrono::duration<double, milli>(budgetMs));
+
+  int n = nodes.size();
+  state.left.resize(n);
+  state.right.resize(n);
+  state.heights.assign(n, 0);
+  state.boxes.resize(n);
+  for (int i = 0; i < n; ++i) {
+    state.boxes[i] = nodes[i].getBoundingBox();
+    if (!nodes[i].isLeaf()) {
+      state.left[i] = i + 1;
+      state.right[i] = nodes[i].offset;
+    }
+  }
+  for (int i = n - 1; i >= 0; --i) {
+    if (!nodes[i].isLeaf())
+      updateHeight(state, i);
+  }
+
+  int total = 0;
+  for (int pass = 0; pass < MAX_PASSES && !state.isExpired(); ++pass) {
+    vector<int> treelets;
+    optimizeTop(state, 0, 0, &treelets);
+
+    // Treelets are disjoint and rotations never change a subtree's box,
+    // so each thread can take every numChunks-th one.
+    atomic<int> rotations(0);
+    int numChunks = std::max(1, std::min<int>(getNumThreads(), treelets.size()));
+    parallelForChunks(numChunks, 0, numChunks, [&](int chunk, int, int) {
+      int count = 0;
+      for (int i = chunk; i < treelets.size(); i += numChunks) {
+        if (state.isExpired())
+          break;
+        count += optimizeSubtree(state, treelets[i], TREELET_DEPTH);
+      }
+      rotations += count;
+    });
+
+    rotations += optimizeTop(state, 0, 0, NULL);
+    total += rotations;
+
+    if (rotations == 0)
+      break;
+  }
+
+  vector<LinearBVHNode> result;
+  result.reserve(n);
+  emit(state, 0, result);
+  nodes.swap(result);
+
+  assert(getLinearBVHDepth(nodes) < LINEAR_BVH_STACK_SIZE);
+
+  return total;
+}
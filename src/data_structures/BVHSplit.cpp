@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVHSplit.h"
+#include "geometry/BoundingBox.h"
+#include "helpers/Parallel.h"
+
+// Nodes at least this large are binned by several threads.
+#define PARALLEL_BINNING_CUTOFF 65536
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+struct Bin {
+  BoundingBox box;
+  int count;
+
+  Bin () : count(0) { }
+};
+
+struct Bounds {
+  BoundingBox box;
+  BoundingBox centroids;
+};
+
+void getBounds (const vector<BoundingBox>& boxes, const vector<vec3>& centroids,
+                const int* indices, int begin, int end, Bounds& bounds) {
+  for (int i = begin; i < end; ++i) {
+    bounds.box.merge(boxes[indices[i]]);
+    bounds.centroids.add(centroids[indices[i]]);
+  }
+}
+
+void binObjects (const vector<BoundingBox>& boxes, const vector<vec3>& centroids,
+                 const int* indices, int begin, int end,
+                 const BVHSplit* candidates, Bin (*bins)[SAH_BINS]) {
+  for (int i = begin; i < end; ++i) {
+    const vec3& centroid = centroids[indices[i]];
+    for (int axis = 0; axis < 3; ++axis) {
+      Bin& bin = bins[axis][candidates[axis].getBin(centroid)];
+      bin.box.merge(boxes[indices[i]]);
+      bin.count++;
+    }
+  }
+}
+
+} // End anonymous namespace for SAH binning.
+
+bool findSAHSplit (const vector<BoundingBox>& boxes,
+                   const vector<vec3>& centroids,
+                   const int* indices, int count, BVHSplit& split) {
+  int numChunks = (count >= PARALLEL_BINNING_CUTOFF) ? getNumChunks(count) : 1;
+
+  Bounds bounds;
+  Bin bins[3][SAH_BINS];
+  BVHSplit candidates[3];
+
+  if (numChunks == 1)
+    getBounds(boxes, centroids, indices, 0, count, bounds);
+  else {
+    vector<Bounds> chunkBounds(numChunks);
+    parallelForChunks(numChunks, 0, count, [&](int c, int b, int e) {
+      getBounds(boxes, centroids, indices, b, e, chunkBounds[c]);
+    });
+    for (const Bounds& chunk : chunkBounds) {
+      bounds.box.merge(chunk.box);
+      bounds.centroids.merge(chunk.centroids);
+    }
+  }
+
+  for (int axis = 0; axis < 3; ++axis) {
+    float extent = bounds.centroids.maxVals[axis] - bounds.centroids.minVals[axis];
+    candidates[axis].axis = axis;
+    candidates[axis].offset = bounds.centroids.minVals[axis];
+    candidates[axis].scale = (extent > 1e-7f) ? SAH_BINS / extent : 0.0f;
+  }
+
+  if (numChunks == 1)
+    binObjects(boxes, centroids, indices, 0, count, candidates, bins);
+  else {
+    vector<Bin> chunkBins(numChunks * 3 * SAH_BINS);
+    parallelForChunks(numChunks, 0, count, [&](int c, int b, int e) {
+      Bin (*mine)[SAH_BINS] = reinterpret_cast<Bin (*)[SAH_BINS]>(&chunkBins[c * 3 * SAH_BINS]);
+      binObjects(boxes, centroids, indices, b, e, candidates, mine);
+    });
+    for (int c = 0; c < numChunks; ++c) {
+      for (int axis = 0; axis < 3; ++axis) {
+        for (int i = 0; i < SAH_BINS; ++i) {
+          const Bin& bin = chunkBins[(c * 3 + axis) * SAH_BINS + i];
+          bins[axis][i].box.merge(bin.box);
+          bins[axis][i].count += bin.count;
+        }
+      }
+    }
+  }
+
+  float area = bounds.box.getSurfaceArea();
+  float invArea = (area > 0.0f) ? 1.0f / area : 0.0f;
+  float leafCost = SAH_INTERSECT_COST * count;
+
+  split.cost = INF;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    // All centroids project to the same point, nothing to split.
+    if (candidates[axis].scale == 0.0f)
+      continue;
+
+    // Sweep from the right to get the cost of everything past each plane.
+    float rightArea[SAH_BINS];
+    int rightCount[SAH_BINS];
+    BoundingBox rightBox;
+    int rightTotal = 0;
+    for (int i = SAH_BINS - 1; i > 0; --i) {
+      rightBox.merge(bins[axis][i].box);
+      rightTotal += bins[axis][i].count;
+      rightArea[i] = rightBox.getSurfaceArea();
+      rightCount[i] = rightTotal;
+    }
+
+    BoundingBox leftBox;
+    int leftTotal = 0;
+    for (int i = 0; i < SAH_BINS - 1; ++i) {
+      leftBox.merge(bins[axis][i].box);
+      leftTotal += bins[axis][i].count;
+
+      if (leftTotal == 0 || rightCount[i+1] == 0)
+        continue;
+
+      float cost = SAH_TRAVERSAL_COST + SAH_INTERSECT_COST * invArea *
+        (leftBox.getSurfaceArea() * leftTotal + rightArea[i+1] * rightCount[i+1]);
+
+      if (cost < split.cost) {
+        split = candidates[axis];
+        split.bin = i;
+        split.cost = cost;
+      }
+    }
+  }
+
+  return split.cost < leafCost;
+}
+
+int partitionSAH (vector<int>& indices, int begin, int end,
+                  const vector<vec3>& centroids, const BVHSplit& split) {
+  return partition(indices.begin() + begin, indices.begin() + end, [&](int i) {
+    return split.isLeft(centroids[i]);
+  }) - indices.begin();
+}
+
+int partitionMedian (vector<int>& indices, int begin, int end,
+                     const vector<BoundingBox>& boxes, int axis) {
+  int mid = (begin + end) / 2;
+  nth_element(indices.begin() + begin, indices.begin() + mid,
+              indices.begin() + end, [&](int lhs, int rhs) {
+    return boxes[lhs].maxVals[axis] < boxes[rhs].maxVals[axis];
+  });
+  float threshold = boxes[indices[mid]].maxVals[axis];
+
+  return partition(indices.begin() + begin, indices.begin() + end, [&](int i) {
+    return boxes[i].maxVals[axis] < threshold;
+  }) - indices.begin();
+}
+
+int partitionObjectMedian (vector<int>& indices, int begin, int end,
+                           const vector<vec3>& centroids, int axis) {
+  int mid = (begin + end) / 2;
+  nth_element(indices.begin() + begin, indices.begin() + mid,
+              indices.begin() + end, [&](int lhs, int rhs) {
+    return centroids[lhs][axis] < centroids[rhs][axis];
+  });
+  return mid;
+}
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/DynamicAABBTree.h"
+#include "data_structures/BVHSplit.h"
+
+// Fat boxes this much larger than needed get shrunk on the next move.
+#define HUGE_MARGIN_FACTOR 4.0f
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+BoundingBox combine (const BoundingBox& a, const BoundingBox& b) {
+  BoundingBox box = a;
+  box.merge(b);
+  return box;
+}
+
+} // End anonymous namespace for dynamic tree helpers.
+
+DynamicAABBTree::DynamicAABBTree (float newMargin) :
+  root(DYNAMIC_TREE_NULL), freeList(DYNAMIC_TREE_NULL), nodeCount(0),
+  margin(newMargin) { }
+
+int DynamicAABBTree::allocateNode () {
+  nodeCount++;
+
+  if (freeList == DYNAMIC_TREE_NULL) {
+    nodes.push_back(DynamicTreeNode());
+    return nodes.size() - 1;
+  }
+
+  int index = freeList;
+  freeList = nodes[index].parent;
+  nodes[index] = DynamicTreeNode();
+  return index;
+}
+
+void DynamicAABBTree::freeNode (int index) {
+  nodeCount--;
+  nodes[index] = DynamicTreeNode();
+  nodes[index].parent = freeList;
+  freeList = index;
+}
+
+BoundingBox DynamicAABBTree::getFatBox (RigidBody* object) const {
+  BoundingBox box = object->getBoundingBox();
+  box.minVals -= vec3(margin);
+  box.maxVals += vec3(margin);
+  return box;
+}
+
+int DynamicAABBTree::insert (RigidBody* object) {
+  int leaf = allocateNode();
+  nodes[leaf].object = object;
+  nodes[leaf].box = getFatBox(object);
+  nodes[leaf].height = 0;
+
+  insertLeaf(leaf);
+  return leaf;
+}
+
+void DynamicAABBTree::remove (int proxy) {
+  removeLeaf(proxy);
+  freeNode(proxy);
+}
+
+bool DynamicAABBTree::move (int proxy, const vec3& displacement) {
+  DynamicTreeNode& node = nodes[proxy];
+  BoundingBox box = node.object->getBoundingBox();
+  BoundingBox fatBox = getFatBox(node.object);
+
+  // Stretch along the predicted motion so fast bodies move less often.
+  vec3 stretch = DYNAMIC_TREE_DISPLACEMENT_FACTOR * displacement;
+  for (int i = 0; i < 3; ++i) {
+    if (stretch[i] < 0.0f)
+      fatBox.minVals[i] += stretch[i];
+    else
+      fatBox.maxVals[i] += stretch[i];
+  }
+
+  // Still inside the fat box, and the fat box is not grossly oversized
+  // compared to the one it would get now. The current fat box still
+  // trails behind by the last displacement, so allow for that too.
+  BoundingBox hugeBox = fatBox;
+  hugeBox.minVals -= vec3(HUGE_MARGIN_FACTOR * margin) + glm::max(stretch, 0.0f);
+  hugeBox.maxVals += vec3(HUGE_MARGIN_FACTOR * margin) + glm::max(-stretch, 0.0f);
+  if (node.box.contains(box) && hugeBox.contains(node.box))
+    return false;
+
+  removeLeaf(proxy);
+  nodes[proxy].box = fatBox;
+
+  insertLeaf(proxy);
+  return true;
+}
+
+void DynamicAABBTree::insertLeaf (int leaf) {
+  if (root == DYNAMIC_TREE_NULL) {
+    root = leaf;
+    nodes[leaf].parent = DYNAMIC_TREE_NULL;
+    return;
+  }
+
+  // Walk down to the sibling that adds the least surface area. Descending
+  // costs the area growth of every ancestor, so stop once that exceeds
+  // the cost of pairing with the current node.
+  BoundingBox leafBox = nodes[leaf].box;
+  int index = root;
+  while (!nodes[index].isLeaf()) {
+    const DynamicTreeNode& node = nodes[index];
+
+    float area = node.box.getSurfaceArea();
+    float combinedArea = combine(node.box, leafBox).getSurfaceArea();
+
+    float cost = 2.0f * combinedArea;
+    float inheritedCost = 2.0f * (combinedArea - area);
+
+    float childCost[2];
+    int children[2] = { node.left, node.right };
+    for (int i = 0; i < 2; ++i) {
+      const DynamicTreeNode& child = nodes[children[i]];
+      float newArea = combine(child.box, leafBox).getSurfaceArea();
+      if (child.isLeaf())
+        childCost[i] = newArea + inheritedCost;
+      else
+        childCost[i] = newArea - child.box.getSurfaceArea() + inheritedCost;
+    }
+
+    if (cost < childCost[0] && cost < childCost[1])
+      break;
+
+    index = (childCost[0] < childCost[1]) ? children[0] : children[1];
+  }
+
+  int sibling = index;
+
+  // Allocating may grow the node array, so no references are held here.
+  int oldParent = nodes[sibling].parent;
+  int newParent = allocateNode();
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].box = combine(leafBox, nodes[sibling].box);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].left = sibling;
+  nodes[newParent].right = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  if (oldParent == DYNAMIC_TREE_NULL)
+    root = newParent;
+  else if (nodes[oldParent].left == sibling)
+    nodes[oldParent].left = newParent;
+  else
+    nodes[oldParent].right = newParent;
+
+  refitAncestors(newParent);
+}
+
+void DynamicAABBTree::removeLeaf (int leaf) {
+  if (leaf == root) {
+    root = DYNAMIC_TREE_NULL;
+    return;
+  }
+
+  int parent = nodes[leaf].parent;
+  int grandParent = nodes[parent].parent;
+  int sibling = (nodes[parent].left == leaf) ?
+    nodes[parent].right : nodes[parent].left;
+
+  // The sibling takes the parent's place.
+  nodes[sibling].parent = grandParent;
+  freeNode(parent);
+
+  if (grandParent == DYNAMIC_TREE_NULL) {
+    root = sibling;
+  }
+  else {
+    if (nodes[grandParent].left == parent)
+      nodes[grandParent].left = sibling;
+    else
+      nodes[grandParent].right = sibling;
+    refitAncestors(grandParent);
+  }
+
+  nodes[leaf].parent = DYNAMIC_TREE_NULL;
+}
+
+void DynamicAABBTree::refitAncestors (int index) {
+  while (index != DYNAMIC_TREE_NULL) {
+    index = balance(index);
+
+    DynamicTreeNode& node = nodes[index];
+    const DynamicTreeNode& left = nodes[node.left];
+    const DynamicTreeNode& right = nodes[node.right];
+    node.height = 1 + std::max(left.height, right.height);
+    node.box = combine(left.box, right.box);
+
+    index = node.parent;
+  }
+}
+
+int DynamicAABBTree::balance (int a) {
+  DynamicTreeNode& A = nodes[a];
+  if (A.isLeaf() || A.height < 2)
+    return a;
+
+  int b = A.left;
+  int c = A.right;
+  DynamicTreeNode& B = nodes[b];
+  DynamicTreeNode& C = nodes[c];
+
+  int diff = C.height - B.height;
+  if (diff >= -1 && diff <= 1)
+    return a;
+
+  // Promote the taller child, A takes the place of its shorter grandchild.
+  int up = (diff > 1) ? c : b;
+  DynamicTreeNode& U = nodes[up];
+  int f = U.left;
+  int g = U.right;
+  DynamicTreeNode& F = nodes[f];
+  DynamicTreeNode& G = nodes[g];
+
+  U.left = a;
+  U.parent = A.parent;
+  A.parent = up;
+
+  if (U.parent == DYNAMIC_TREE_NULL)
+    root = up;
+  else if (nodes[U.parent].left == a)
+    nodes[U.parent].left = up;
+  else
+    nodes[U.parent].right = up;
+
+  // The taller grandchild stays under U.
+  int keep = (F.height > G.height) ? f : g;
+  int give = (keep == f) ? g : f;
+  U.right = keep;
+  nodes[give].parent = a;
+  if (up == c)
+    A.right = give;
+  else
+    A.left = give;
+
+  const DynamicTreeNode& other = nodes[(up == c) ? b : c];
+  A.box = combine(other.box, nodes[give].box);
+  A.height = 1 + std::max(other.height, nodes[give].height);
+  U.box = combine(A.box, nodes[keep].box);
+  U.height = 1 + std::max(A.height, nodes[keep].height);
+
+  return up;
+}
+
+int DynamicAABBTree::getHeight () const {
+  if (root == DYNAMIC_TREE_NULL)
+    return 0;
+  return nodes[root].height;
+}
+
+float DynamicAABBTree::getSAHCost () const {
+  if (root == DYNAMIC_TREE_NULL)
+    return 0.0f;
+
+  float rootArea = nodes[root].box.getSurfaceArea();
+  if (rootArea <= 0.0f)
+    return 0.0f;
+
+  float cost = 0.0f;
+  for (const DynamicTreeNode& node : nodes) {
+    if (node.height < 0)
+      continue;
+    float area = node.box.getSurfaceArea();
+    if (node.isLeaf())
+      cost += area * SAH_INTERSECT_COST;
+    else
+      cost += area * SAH_TRAVERSAL_COST;
+  }
+  return cost / rootArea;
+}
+
+void DynamicAABBTree::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  for (const DynamicTreeNode& node : nodes) {
+    if (node.height >= 0)
+      allBoxes.push_back(node.box);
+  }
+}
+
+void DynamicAABBTree::getOverlappingPairs (vector<RigidBodyPair>& pairs) const {
+  for (int i = 0; i < nodes.size(); ++i) {
+    const DynamicTreeNode& node = nodes[i];
+    if (node.height != 0)
+      continue;
+
+    // Fat boxes contain the real ones, so querying with the real box finds
+    // every overlap. Each pair is reported from its lower proxy only.
+    BoundingBox box = node.object->getBoundingBox();
+    queryBox(box, [&](int other) {
+      if (other <= i)
+        return;
+      RigidBody* rigid = nodes[other].object;
+      if (box.intersects(rigid->getBoundingBox()))
+        pairs.push_back(RigidBodyPair(node.object, rigid));
+    });
+  }
+}
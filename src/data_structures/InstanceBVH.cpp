@@ -0,0 +1,153 @@
+#include <cassert>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/InstanceBVH.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Object space copy of a world ray. Ray normalizes its direction, so
+// distances scale by the length of the transformed direction.
+Ray toObjectSpace (const MeshInstance& instance, const Ray& ray,
+                   float& scale) {
+  vec3 origin = vec3(instance.toObject * vec4(ray.position, 1.0f));
+  vec3 direction = vec3(instance.toObject * vec4(ray.direction, 0.0f));
+  scale = length(direction);
+  return Ray(origin, direction);
+}
+
+} // End anonymous namespace for instance helpers.
+
+MeshInstance::MeshInstance (const MeshBVH* newMesh, const mat4& newToWorld) :
+  mesh(newMesh) {
+  setTransform(newToWorld);
+}
+
+void MeshInstance::setTransform (const mat4& newToWorld) {
+  toWorld = newToWorld;
+  toObject = inverse(newToWorld);
+
+  box = BoundingBox();
+  if (mesh->nodes.empty())
+    return;
+
+  BoundingBox local = mesh->nodes[0].getBoundingBox();
+  for (const vec4& corner : local.getVertices())
+    box.add(vec3(toWorld * corner));
+}
+
+int InstanceBVH::addInstance (const MeshBVH* mesh, const mat4& toWorld) {
+  instances.push_back(MeshInstance(mesh, toWorld));
+  return instances.size() - 1;
+}
+
+void InstanceBVH::setTransform (int instance, const mat4& toWorld) {
+  instances[instance].setTransform(toWorld);
+}
+
+void InstanceBVH::build (BVHSplitMethod method) {
+  vector<BoundingBox> boxes;
+  vector<vec3> centroids;
+  for (const MeshInstance& instance : instances) {
+    boxes.push_back(instance.box);
+    centroids.push_back(instance.box.getCenter());
+  }
+
+  buildLinearBVHNodes(boxes, centroids, method, nodes, order);
+}
+
+void InstanceBVH::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  for (const LinearBVHNode& node : nodes)
+    allBoxes.push_back(node.getBoundingBox());
+}
+
+bool InstanceBVH::getIntersection (const Ray& ray, InstanceHit& hit,
+                                   float tMin, float tMax) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  bool result = false;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    float tNear;
+    if (!node.intersects(ray, tMax, tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        const MeshInstance& instance = instances[order[i]];
+        float scale;
+        Ray local = toObjectSpace(instance, ray, scale);
+
+        MeshHit meshHit;
+        if (instance.mesh->getIntersection(local, meshHit, tMin * scale,
+                                           tMax * scale)) {
+          static_cast<MeshHit&>(hit) = meshHit;
+          hit.timeHit = meshHit.timeHit / scale;
+          hit.instance = order[i];
+          tMax = hit.timeHit;
+          result = true;
+        }
+      }
+    }
+    // Visit the child on the near side of the split first.
+    else if (ray.direction[node.axis] < 0.0f) {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = index + 1;
+      stack[top++] = node.offset;
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return result;
+}
+
+bool InstanceBVH::isOccluded (const Ray& ray, float tMin, float tMax) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    float tNear;
+    if (!node.intersects(ray, tMax, tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        const MeshInstance& instance = instances[order[i]];
+        float scale;
+        Ray local = toObjectSpace(instance, ray, scale);
+        if (instance.mesh->isOccluded(local, tMin * scale, tMax * scale))
+          return true;
+      }
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/BVHSplit.h"
+#include "data_structures/LBVH.h"
+#include "data_structures/LinearBVH.h"
+#include "helpers/Morton.h"
+#include "helpers/Parallel.h"
+#include "physics/RigidBody.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Internal nodes are 0 ... n-2, leaf i is n-1+i.
+struct KarrasNode {
+  int child[2];
+  int first;
+  int last;
+};
+
+struct BuildContext {
+  int n;
+  vector<uint64_t> keys;
+  vector<int> sorted;
+  vector<BoundingBox> boxes;
+  vector<KarrasNode> internal;
+  vector<int> parents;
+  vector<BoundingBox> bounds;
+};
+
+// Length of the common prefix of keys i and j, ties broken by index.
+int delta (const BuildContext& ctx, int i, int j) {
+  if (j < 0 || j >= ctx.n)
+    return -1;
+  uint64_t x = ctx.keys[i] ^ ctx.keys[j];
+  if (x == 0)
+    return 64 + __builtin_clz(static_cast<uint32_t>(i ^ j));
+  return __builtin_clzll(x);
+}
+
+void buildInternalNode (BuildContext& ctx, int i) {
+  // Direction of the range covered by this node.
+  int d = (delta(ctx, i, i + 1) - delta(ctx, i, i - 1)) >= 0 ? 1 : -1;
+  int deltaMin = delta(ctx, i, i - d);
+
+  // Upper bound on the range length, then binary search the other end.
+  int lMax = 2;
+  while (delta(ctx, i, i + lMax * d) > deltaMin)
+    lMax *= 2;
+
+  int l = 0;
+  for (int t = lMax / 2; t >= 1; t /= 2) {
+    if (delta(ctx, i, i + (l + t) * d) > deltaMin)
+      l += t;
+  }
+  int j = i + l * d;
+
+  // Binary search for the split position.
+  int deltaNode = delta(ctx, i, j);
+  int s = 0;
+  int t = l;
+  do {
+    t = (t + 1) / 2;
+    if (delta(ctx, i, i + (s + t) * d) > deltaNode)
+      s += t;
+  } while (t > 1);
+  int gamma = i + s * d + std::min(d, 0);
+
+  KarrasNode& node = ctx.internal[i];
+  node.first = std::min(i, j);
+  node.last = std::max(i, j);
+  node.child[0] = (node.first == gamma) ? ctx.n - 1 + gamma : gamma;
+  node.child[1] = (node.last == gamma + 1) ? ctx.n + gamma : gamma + 1;
+
+  ctx.parents[node.child[0]] = i;
+  ctx.parents[node.child[1]] = i;
+}
+
+// The second child to arrive at a node merges both boxes and carries on up.
+void propagateBounds (BuildContext& ctx, atomic<int>* visits, int leaf) {
+  int node = ctx.n - 1 + leaf;
+  ctx.bounds[node] = ctx.boxes[ctx.sorted[leaf]];
+
+  int parent = ctx.parents[node];
+  while (parent >= 0) {
+    if (visits[parent].fetch_add(1, memory_order_acq_rel) == 0)
+      return;
+
+    const KarrasNode& p = ctx.internal[parent];
+    BoundingBox box = ctx.bounds[p.child[0]];
+    box.merge(ctx.bounds[p.child[1]]);
+    ctx.bounds[parent] = box;
+
+    parent = ctx.parents[parent];
+  }
+}
+
+// Writes sorted objects first ... last out as a balanced tree.
+int emitRange (const BuildContext& ctx, vector<LinearBVHNode>& nodes,
+               int first, int last) {
+  int index = nodes.size();
+  nodes.push_back(LinearBVHNode());
+
+  BoundingBox box;
+  for (int i = first; i <= last; ++i)
+    box.merge(ctx.boxes[ctx.sorted[i]]);
+  nodes[index].minVals = box.minVals;
+  nodes[index].maxVals = box.maxVals;
+  nodes[index].axis = box.getLongestAxis();
+
+  if (last - first + 1 <= BVH_LEAF_CAP) {
+    nodes[index].offset = first;
+    nodes[index].count = last - first + 1;
+    return index;
+  }
+
+  int mid = (first + last) / 2;
+
+  nodes[index].count = 0;
+
+  emitRange(ctx, nodes, first, mid);
+  int right = emitRange(ctx, nodes, mid + 1, last);
+
+  nodes[index].offset = right;
+
+  return index;
+}
+
+// Writes the Karras tree out in depth first order, collapsing small ranges.
+// Clustered keys can nest far deeper than the traversal stacks allow, so
+// past BVH_SAH_DEPTH_CAP the rest of a range is split at its midpoint.
+int emit (const BuildContext& ctx, vector<LinearBVHNode>& nodes, int node,
+          int level) {
+  bool isLeaf = (node >= ctx.n - 1);
+  int first = isLeaf ? node - (ctx.n - 1) : ctx.internal[node].first;
+  int last = isLeaf ? first : ctx.internal[node].last;
+
+  if (!isLeaf && level >= BVH_SAH_DEPTH_CAP)
+    return emitRange(ctx, nodes, first, last);
+
+  int index = nodes.size();
+  nodes.push_back(LinearBVHNode());
+
+  const BoundingBox& box = ctx.bounds[node];
+  nodes[index].minVals = box.minVals;
+  nodes[index].maxVals = box.maxVals;
+  nodes[index].axis = box.getLongestAxis();
+
+  if (isLeaf || last - first + 1 < BVH_LEAF_CAP) {
+    nodes[index].offset = first;
+    nodes[index].count = last - first + 1;
+    return index;
+  }
+
+  nodes[index].count = 0;
+
+  emit(ctx, nodes, ctx.internal[node].child[0], level + 1);
+  int right = emit(ctx, nodes, ctx.internal[node].child[1], level + 1);
+
+  nodes[index].offset = right;
+
+  return index;
+}
+
+} // End anonymous namespace for Karras construction helpers.
+
+void buildLBVH (const vector<RigidBody*>& objects, LinearBVH& bvh,
+                int mortonBits) {
+  BuildContext ctx;
+  ctx.n = objects.size();
+
+  bvh.objects = objects;
+  bvh.nodes.clear();
+  bvh.primitives.clear();
+  bvh.buildSAHCost = 0.0f;
+
+  if (ctx.n == 0)
+    return;
+
+  int n = ctx.n;
+  int numChunks = getNumChunks(n);
+
+  ctx.boxes.resize(n);
+  vector<BoundingBox> chunkBounds(numChunks);
+
+  parallelForChunks(numChunks, 0, n, [&](int c, int b, int e) {
+    for (int i = b; i < e; ++i) {
+      ctx.boxes[i] = objects[i]->getBoundingBox();
+      chunkBounds[c].add(ctx.boxes[i].getCenter());
+    }
+  });
+
+  BoundingBox centroidBounds;
+  for (const BoundingBox& box : chunkBounds)
+    centroidBounds.merge(box);
+
+  vec3 extent = centroidBounds.maxVals - centroidBounds.minVals;
+  vec3 invExtent;
+  for (int i = 0; i < 3; ++i)
+    invExtent[i] = (extent[i] > 0.0f) ? 1.0f / extent[i] : 0.0f;
+
+  ctx.keys.resize(n);
+  ctx.sorted.resize(n);
+  parallelFor(0, n, [&](int i) {
+    vec3 p = (ctx.boxes[i].getCenter() - centroidBounds.minVals) * invExtent;
+    ctx.keys[i] = (mortonBits > 30) ? getMortonCode63(p) : getMortonCode30(p);
+    ctx.sorted[i] = i;
+  });
+
+  parallelRadixSort(ctx.keys, ctx.sorted, (mortonBits > 30) ? 63 : 30);
+
+  ctx.internal.resize(std::max(n - 1, 0));
+  ctx.parents.assign(2 * n - 1, -1);
+  ctx.bounds.resize(2 * n - 1);
+
+  parallelFor(0, n - 1, [&](int i) {
+    buildInternalNode(ctx, i);
+  });
+
+  unique_ptr<atomic<int>[]> visits(new atomic<int>[std::max(n - 1, 1)]);
+  parallelFor(0, n - 1, [&](int i) {
+    visits[i].store(0, memory_order_relaxed);
+  });
+
+  parallelFor(0, n, [&](int i) {
+    propagateBounds(ctx, visits.get(), i);
+  });
+
+  // Internal node 0 is the root. A single object has no internal nodes
+  // and its leaf also ends up at index 0.
+  bvh.nodes.reserve(2 * n - 1);
+  emit(ctx, bvh.nodes, 0, 0);
+  bvh.nodes.shrink_to_fit();
+  assert(getLinearBVHDepth(bvh.nodes) < LINEAR_BVH_STACK_SIZE);
+
+  bvh.primitives.swap(ctx.sorted);
+  bvh.buildSAHCost = bvh.getSAHCost();
+}
@@ -0,0 +1,198 @@
+#include <mutex>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/LazyBVH.h"
+#include "data_structures/BVH.h"
+#include "data_structures/BVHSplit.h"
+#include "helpers/Parallel.h"
+
+using namespace std;
+using namespace glm;
+
+LazyBVH::LazyBVH (const vector<RigidBody*>& newObjects,
+                  BVHSplitMethod newMethod) :
+  objects(newObjects), method(newMethod), root(NULL), expandedCount(0) {
+  int n = objects.size();
+  boxes.resize(n);
+  centroids.resize(n);
+  indices.resize(n);
+  parallelFor(0, n, [&](int i) {
+    boxes[i] = objects[i]->getBoundingBox();
+    centroids[i] = boxes[i].getCenter();
+    indices[i] = i;
+  });
+
+  BoundingBox box;
+  for (const BoundingBox& b : boxes)
+    box.merge(b);
+  root = new LazyBVHNode(box, 0, n, 0);
+}
+
+void LazyBVH::expand (LazyBVHNode* node) {
+  if (node->expanded.load(memory_order_acquire))
+    return;
+
+  lock_guard<mutex> guard(node->lock);
+  if (node->expanded.load(memory_order_relaxed))
+    return;
+
+  // Nobody reads indices[begin, end) of an unexpanded node, so it can be
+  // reordered here while other threads query elsewhere.
+  int begin = node->begin;
+  int end = node->end;
+  int count = end - begin;
+  int depthCap = (method == SPLIT_SAH) ? BVH_SAH_DEPTH_CAP : BVH_DEPTH_CAP;
+  int mid = begin;
+
+  if (count >= BVH_LEAF_CAP && node->level < depthCap) {
+    if (method == SPLIT_SAH) {
+      BVHSplit split;
+      if (findSAHSplit(boxes, centroids, &indices[begin], count, split))
+        mid = partitionSAH(indices, begin, end, centroids, split);
+    }
+    else {
+      mid = partitionMedian(indices, begin, end, boxes,
+                            node->box.getLongestAxis());
+    }
+  }
+
+  if (mid != begin && mid != end) {
+    BoundingBox leftBox;
+    BoundingBox rightBox;
+    for (int i = begin; i < mid; ++i)
+      leftBox.merge(boxes[indices[i]]);
+    for (int i = mid; i < end; ++i)
+      rightBox.merge(boxes[indices[i]]);
+
+    node->left = new LazyBVHNode(leftBox, begin, mid, node->level + 1);
+    node->right = new LazyBVHNode(rightBox, mid, end, node->level + 1);
+  }
+
+  expandedCount++;
+  node->expanded.store(true, memory_order_release);
+}
+
+bool LazyBVH::getIntersection (const Sphere& obj, Intersection& isect) {
+  LazyBVHNode* stack[BVH_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = root;
+
+  Intersection tmp;
+
+  while (top > 0) {
+    LazyBVHNode* node = stack[--top];
+
+    if (obj.intersects(node->box, tmp) == false)
+      continue;
+
+    expand(node);
+
+    if (node->isLeaf()) {
+      for (int i = node->begin; i < node->end; ++i) {
+        RigidBody* rigid = objects[indices[i]];
+        if (rigid == &obj)
+          continue;
+        if (obj.intersects(boxes[indices[i]], tmp)) {
+          isect.hit = true;
+          return true;
+        }
+      }
+    }
+    else {
+      stack[top++] = node->right;
+      stack[top++] = node->left;
+    }
+  }
+
+  return false;
+}
+
+bool LazyBVH::getIntersection (const Ray& ray, Intersection& isect) {
+  LazyBVHNode* stack[BVH_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = root;
+
+  bool result = false;
+
+  while (top > 0) {
+    LazyBVHNode* node = stack[--top];
+
+    // Nothing in this box can beat the closest hit found so far.
+    Intersection boxIsect;
+    if (!node->box.intersects(ray, boxIsect) ||
+        (isect.hit && boxIsect.timeHit > isect.timeHit))
+      continue;
+
+    expand(node);
+
+    if (node->isLeaf()) {
+      for (int i = node->begin; i < node->end; ++i) {
+        Intersection rigidIsect;
+        if (objects[indices[i]]->intersects(ray, rigidIsect)) {
+          result = true;
+          if (isect.hit == false || isect.timeHit > rigidIsect.timeHit)
+            isect = rigidIsect;
+        }
+      }
+    }
+    // Visit the nearer child first, it pops last.
+    else if (dot(node->right->box.getCenter() - node->left->box.getCenter(),
+                 ray.direction) < 0.0f) {
+      stack[top++] = node->left;
+      stack[top++] = node->right;
+    }
+    else {
+      stack[top++] = node->right;
+      stack[top++] = node->left;
+    }
+  }
+
+  return result;
+}
+
+bool LazyBVH::isOccluded (const Ray& ray, float tMin, float tMax) {
+  LazyBVHNode* stack[BVH_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = root;
+
+  while (top > 0) {
+    LazyBVHNode* node = stack[--top];
+
+    Intersection boxIsect;
+    if (!node->box.intersects(ray, boxIsect) || boxIsect.timeHit > tMax)
+      continue;
+
+    expand(node);
+
+    if (node->isLeaf()) {
+      for (int i = node->begin; i < node->end; ++i) {
+        Intersection rigidIsect;
+        if (objects[indices[i]]->intersects(ray, rigidIsect) &&
+            rigidIsect.timeHit > tMin && rigidIsect.timeHit < tMax)
+          return true;
+      }
+    }
+    else {
+      stack[top++] = node->right;
+      stack[top++] = node->left;
+    }
+  }
+
+  return false;
+}
+
+void LazyBVH::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  vector<const LazyBVHNode*> stack;
+  stack.push_back(root);
+  while (!stack.empty()) {
+    const LazyBVHNode* node = stack.back();
+    stack.pop_back();
+    allBoxes.push_back(node->box);
+    if (node->expanded.load(memory_order_acquire) && !node->isLeaf()) {
+      stack.push_back(node->right);
+      stack.push_back(node->left);
+    }
+  }
+}
@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "data_structures/LinearBVH.h"
+#include "data_structures/BVHSplit.h"
+#include "helpers/Parallel.h"
+#include "geometry/Sphere.h"
+#include "physics/Intersection.h"
+#include "physics/RigidBody.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+struct BuildContext {
+  vector<LinearBVHNode>& nodes;
+  vector<int>& primitives;
+  const vector<BoundingBox>& boxes;
+  const vector<vec3>& centroids;
+  BVHSplitMethod method;
+
+  BuildContext (vector<LinearBVHNode>& n, vector<int>& p,
+                const vector<BoundingBox>& b, const vector<vec3>& c,
+                BVHSplitMethod m) :
+    nodes(n), primitives(p), boxes(b), centroids(c), method(m) { }
+};
+
+int buildRecursive (BuildContext& ctx, int begin, int end, int level) {
+  int index = ctx.nodes.size();
+  ctx.nodes.push_back(LinearBVHNode());
+
+  BoundingBox box;
+  for (int i = begin; i < end; ++i)
+    box.merge(ctx.boxes[ctx.primitives[i]]);
+
+  int count = end - begin;
+  int axis = box.getLongestAxis();
+  int mid = begin;
+
+  if (ctx.method == SPLIT_SAH) {
+    BVHSplit split;
+    if (count >= BVH_LEAF_CAP && level < BVH_SAH_DEPTH_CAP &&
+        findSAHSplit(ctx.boxes, ctx.centroids, &ctx.primitives[begin], count, split)) {
+      axis = split.axis;
+      mid = partitionSAH(ctx.primitives, begin, end, ctx.centroids, split);
+    }
+  }
+  else if (count >= BVH_LEAF_CAP && level < BVH_DEPTH_CAP) {
+    mid = partitionMedian(ctx.primitives, begin, end, ctx.boxes, axis);
+  }
+
+  // Leaves are capped in size so the count fits in the node.
+  if ((mid == begin || mid == end) && count > LINEAR_BVH_MAX_LEAF_SIZE)
+    mid = partitionObjectMedian(ctx.primitives, begin, end, ctx.centroids, axis);
+
+  LinearBVHNode& node = ctx.nodes[index];
+  node.minVals = box.minVals;
+  node.maxVals = box.maxVals;
+  node.axis = axis;
+
+  if (mid == begin || mid == end) {
+    node.offset = begin;
+    node.count = count;
+    return index;
+  }
+
+  node.count = 0;
+
+  buildRecursive(ctx, begin, mid, level + 1);
+  int right = buildRecursive(ctx, mid, end, level + 1);
+
+  ctx.nodes[index].offset = right;
+
+  return index;
+}
+
+// Bit i is set when ray i of the packet enters the node before tMax[i].
+int intersectsBox (const LinearBVHNode& node, const RayPacket& packet,
+                   const float* tMax) {
+#if defined(__AVX__)
+  __m256 tNear = _mm256_setzero_ps();
+  __m256 tFar = _mm256_load_ps(tMax);
+
+  const float* origins[3] = { packet.originX, packet.originY, packet.originZ };
+  const float* invDirs[3] = { packet.invDirX, packet.invDirY, packet.invDirZ };
+
+  for (int i = 0; i < 3; ++i) {
+    __m256 o = _mm256_load_ps(origins[i]);
+    __m256 inv = _mm256_load_ps(invDirs[i]);
+    __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.minVals[i]), o), inv);
+    __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.maxVals[i]), o), inv);
+    tNear = _mm256_max_ps(tNear, _mm256_min_ps(t1, t2));
+    tFar = _mm256_min_ps(tFar, _mm256_max_ps(t1, t2));
+  }
+
+  return _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+#elif defined(__SSE__)
+  const float* origins[3] = { packet.originX, packet.originY, packet.originZ };
+  const float* invDirs[3] = { packet.invDirX, packet.invDirY, packet.invDirZ };
+
+  int mask = 0;
+  for (int lane = 0; lane < RAY_PACKET_SIZE; lane += 4) {
+    __m128 tNear = _mm_setzero_ps();
+    __m128 tFar = _mm_load_ps(tMax + lane);
+
+    for (int i = 0; i < 3; ++i) {
+      __m128 o = _mm_load_ps(origins[i] + lane);
+      __m128 inv = _mm_load_ps(invDirs[i] + lane);
+      __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minVals[i]), o), inv);
+      __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxVals[i]), o), inv);
+      tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+      tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+    }
+
+    mask |= _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) << lane;
+  }
+  return mask;
+#else
+  // Same slab test on the padded lanes, packet.rays only has count rays.
+  const float* origins[3] = { packet.originX, packet.originY, packet.originZ };
+  const float* invDirs[3] = { packet.invDirX, packet.invDirY, packet.invDirZ };
+
+  int mask = 0;
+  for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+    float tNear = 0.0f;
+    float tFar = tMax[lane];
+    for (int i = 0; i < 3; ++i) {
+      float t1 = (node.minVals[i] - origins[i][lane]) * invDirs[i][lane];
+      float t2 = (node.maxVals[i] - origins[i][lane]) * invDirs[i][lane];
+      tNear = std::max(tNear, std::min(t1, t2));
+      tFar = std::min(tFar, std::max(t1, t2));
+    }
+    if (tNear <= tFar)
+      mask |= 1 << lane;
+  }
+  return mask;
+#endif
+}
+
+} // End anonymous namespace for build and traversal helpers.
+
+void buildLinearBVHNodes (const vector<BoundingBox>& boxes,
+                          const vector<vec3>& centroids, BVHSplitMethod method,
+                          vector<LinearBVHNode>& nodes, vector<int>& primitives) {
+  nodes.clear();
+  primitives.resize(boxes.size());
+  for (int i = 0; i < boxes.size(); ++i)
+    primitives[i] = i;
+
+  if (boxes.empty())
+    return;
+
+  BuildContext ctx(nodes, primitives, boxes, centroids, method);
+  nodes.reserve(2 * boxes.size() - 1);
+  buildRecursive(ctx, 0, boxes.size(), 0);
+  nodes.shrink_to_fit();
+
+  assert(getLinearBVHDepth(nodes) < LINEAR_BVH_STACK_SIZE);
+}
+
+int getLinearBVHDepth (const vector<LinearBVHNode>& nodes) {
+  // Parents come before their children, so one forward pass is enough.
+  vector<int> depths(nodes.size(), 0);
+  int deepest = 0;
+  for (int i = 0; i < nodes.size(); ++i) {
+    deepest = std::max(deepest, depths[i]);
+    if (nodes[i].count == 0) {
+      depths[i + 1] = depths[i] + 1;
+      depths[nodes[i].offset] = depths[i] + 1;
+    }
+  }
+  return deepest;
+}
+
+LinearBVH::LinearBVH (const vector<RigidBody*>& newObjects,
+                      BVHSplitMethod method) :
+  objects(newObjects), buildSAHCost(0.0f) {
+  vector<BoundingBox> boxes;
+  vector<vec3> centroids;
+  for (int i = 0; i < objects.size(); ++i) {
+    boxes.push_back(objects[i]->getBoundingBox());
+    centroids.push_back(boxes[i].getCenter());
+  }
+
+  buildLinearBVHNodes(boxes, centroids, method, nodes, primitives);
+
+  buildSAHCost = getSAHCost();
+}
+
+void LinearBVH::refit () {
+  // Children always come after their parent, so walk backwards.
+  for (int index = nodes.size() - 1; index >= 0; --index) {
+    LinearBVHNode& node = nodes[index];
+
+    BoundingBox box;
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i)
+        box.merge(objects[primitives[i]]->getBoundingBox());
+    }
+    else {
+      box.merge(nodes[index + 1].getBoundingBox());
+      box.merge(nodes[node.offset].getBoundingBox());
+    }
+
+    node.minVals = box.minVals;
+    node.maxVals = box.maxVals;
+  }
+}
+
+float LinearBVH::getSAHCost () const {
+  if (nodes.empty())
+    return 0.0f;
+
+  float rootArea = nodes[0].getBoundingBox().getSurfaceArea();
+  if (rootArea <= 0.0f)
+    return 0.0f;
+
+  float cost = 0.0f;
+  for (const LinearBVHNode& node : nodes) {
+    float area = node.getBoundingBox().getSurfaceArea();
+    if (node.isLeaf())
+      cost += area * SAH_INTERSECT_COST * node.count;
+    else
+      cost += area * SAH_TRAVERSAL_COST;
+  }
+  return cost / rootArea;
+}
+
+float LinearBVH::getRefitRatio () const {
+  if (buildSAHCost <= 0.0f)
+    return 1.0f;
+  return getSAHCost() / buildSAHCost;
+}
+
+void LinearBVH::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  for (const LinearBVHNode& node : nodes)
+    allBoxes.push_back(node.getBoundingBox());
+}
+
+bool LinearBVH::getIntersection (const Sphere& obj, Intersection& isect) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  Intersection tmp;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    if (obj.intersects(node.getBoundingBox(), tmp) == false)
+      continue;
+
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        RigidBody* rigid = objects[primitives[i]];
+        if (rigid == &obj)
+          continue;
+        if (obj.intersects(rigid->getBoundingBox(), tmp)) {
+          isect.hit = true;
+          return true;
+        }
+      }
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return false;
+}
+
+bool LinearBVH::getIntersection (const Ray& ray, Intersection& isect) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  bool result = false;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    float tMax = isect.hit ? isect.timeHit : INF;
+    float tNear;
+    if (!node.intersects(ray, tMax, tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        Intersection rigidIsect;
+        if (objects[primitives[i]]->intersects(ray, rigidIsect)) {
+          result = true;
+          if (isect.hit == false || isect.timeHit > rigidIsect.timeHit)
+            isect = rigidIsect;
+        }
+      }
+    }
+    // Visit the child on the near side of the split first.
+    else if (ray.direction[node.axis] < 0.0f) {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = index + 1;
+      stack[top++] = node.offset;
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return result;
+}
+
+bool LinearBVH::isOccluded (const Ray& ray, float tMin, float tMax) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    float tNear;
+    if (!node.intersects(ray, tMax, tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        Intersection rigidIsect;
+        if (objects[primitives[i]]->intersects(ray, rigidIsect) &&
+            rigidIsect.timeHit > tMin && rigidIsect.timeHit < tMax)
+          return true;
+      }
+    }
+    else if (ray.direction[node.axis] < 0.0f) {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = index + 1;
+      stack[top++] = node.offset;
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return false;
+}
+
+void LinearBVH::isOccluded (const vector<Ray>& rays, vector<uint8_t>& occluded,
+                            float tMin, float tMax) const {
+  occluded.resize(rays.size());
+  parallelFor(0, rays.size(), [&](int i) {
+    occluded[i] = isOccluded(rays[i], tMin, tMax);
+  });
+}
+
+int LinearBVH::getIntersection (const RayPacket& packet,
+                                Intersection* isects) const {
+  if (nodes.empty() || packet.count == 0)
+    return 0;
+
+  // Per ray upper bound on the hit distance, unused lanes never hit.
+  alignas(32) float tMax[RAY_PACKET_SIZE];
+  for (int i = 0; i < RAY_PACKET_SIZE; ++i) {
+    if (i >= packet.count)
+      tMax[i] = -1.0f;
+    else
+      tMax[i] = isects[i].hit ? isects[i].timeHit : INF;
+  }
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  int hitMask = 0;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    int active = intersectsBox(node, packet, tMax);
+    if (active == 0)
+      continue;
+
+    if (node.isLeaf()) {
+      for (int lane = 0; lane < packet.count; ++lane) {
+        if ((active & (1 << lane)) == 0)
+          continue;
+
+        const Ray& ray = packet.rays[lane];
+        Intersection& isect = isects[lane];
+
+        for (int i = node.offset; i < node.offset + node.count; ++i) {
+          Intersection rigidIsect;
+          if (objects[primitives[i]]->intersects(ray, rigidIsect)) {
+            if (isect.hit == false || isect.timeHit > rigidIsect.timeHit)
+              isect = rigidIsect;
+            tMax[lane] = isect.timeHit;
+            hitMask |= 1 << lane;
+          }
+        }
+      }
+    }
+    // Near child first, judged by the first active ray.
+    else {
+      int lane = 0;
+      while ((active & (1 << lane)) == 0)
+        ++lane;
+
+      if (packet.rays[lane].direction[node.axis] < 0.0f) {
+        assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+        stack[top++] = index + 1;
+        stack[top++] = node.offset;
+      }
+      else {
+        assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+        stack[top++] = node.offset;
+        stack[top++] = index + 1;
+      }
+    }
+  }
+
+  int hits = 0;
+  for (int lane = 0; lane < packet.count; ++lane)
+    hits += (hitMask >> lane) & 1;
+  return hits;
+}
+
+void LinearBVH::getIntersections (const vector<Ray>& rays,
+                                  vector<Intersection>& isects) const {
+  isects.assign(rays.size(), Intersection());
+  for (int i = 0; i < rays.size(); i += RAY_PACKET_SIZE) {
+    RayPacket packet(&rays[i], rays.size() - i);
+    getIntersection(packet, &isects[i]);
+  }
+}
@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/LinearOctree.h"
+#include "helpers/Morton.h"
+#include "helpers/Parallel.h"
+
+using namespace std;
+using namespace glm;
+
+LinearOctree::LinearOctree (const vector<RigidBody*>& newObjects,
+                            BoundingBox bbox, int newDepthCap, int leafCap) :
+  box(bbox), depthCap(std::min(newDepthCap, LINEAR_OCTREE_MAX_LEVEL)) {
+  int n = newObjects.size();
+
+  if (box.isEmpty) {
+    for (RigidBody* object : newObjects)
+      box.add(object->position);
+  }
+
+  // Same uniform cube as OctTreeNode.
+  float dx = 0.0f;
+  for (int i = 0; i < 3; i++)
+    dx = std::max(dx, (box.maxVals[i] - box.minVals[i]) / 2.0f);
+  for (int i = 0; i < 3; i++)
+    box.maxVals[i] = box.minVals[i] + 2.0f * dx;
+
+  // Codes at depthCap levels, found from the full 63 bit code.
+  vector<int> order(n);
+  codes.resize(n);
+  vec3 scale = 1.0f / std::max(2.0f * dx, 1e-9f) * vec3(1.0f);
+  int shift = 3 * (LINEAR_OCTREE_MAX_LEVEL - depthCap);
+  parallelFor(0, n, [&](int i) {
+    vec3 unit = (newObjects[i]->position - box.minVals) * scale;
+    codes[i] = getMortonCode63(unit) >> shift;
+    order[i] = i;
+  });
+
+  parallelRadixSort(codes, order, 3 * depthCap);
+
+  objects.resize(n);
+  for (int i = 0; i < n; i++)
+    objects[i] = newObjects[order[i]];
+
+  if (n > 0)
+    subdivide(LINEAR_OCTREE_ROOT, 0, 0, n, leafCap);
+}
+
+void LinearOctree::subdivide (uint64_t key, int level, int begin, int end,
+                              int leafCap) {
+  if (end - begin <= leafCap || level == depthCap) {
+    LinearOctreeCell cell = { key, begin, end };
+    cells.push_back(cell);
+    return;
+  }
+
+  // Codes are sorted, so every child's objects are contiguous.
+  for (int octant = 0; octant < 8; octant++) {
+    uint64_t child = getChild(key, octant);
+    uint64_t limit = getStart(child) + (1ull << (3 * (depthCap - level - 1)));
+    int childEnd = lower_bound(codes.begin() + begin, codes.begin() + end,
+                               limit) - codes.begin();
+    if (childEnd > begin)
+      subdivide(child, level + 1, begin, childEnd, leafCap);
+    begin = childEnd;
+  }
+}
+
+int LinearOctree::getLevel (uint64_t key) {
+  int level = 0;
+  while (key > LINEAR_OCTREE_ROOT) {
+    key >>= 3;
+    level++;
+  }
+  return level;
+}
+
+uint64_t LinearOctree::getNeighbor (uint64_t key, int dx, int dy, int dz) {
+  int level = getLevel(key);
+  uint64_t sentinel = 1ull << (3 * level);
+  uvec3 cell = decodeMorton63(key ^ sentinel);
+
+  int64_t size = 1ll << level;
+  int64_t x = int64_t(cell.x) + dx;
+  int64_t y = int64_t(cell.y) + dy;
+  int64_t z = int64_t(cell.z) + dz;
+  if (x < 0 || y < 0 || z < 0 || x >= size || y >= size || z >= size)
+    return 0;
+
+  return sentinel | encodeMorton63(uvec3(x, y, z));
+}
+
+uint64_t LinearOctree::getKey (const vec3& point, int level) const {
+  vec3 unit = (point - box.minVals) / (box.maxVals - box.minVals);
+  uint64_t code = getMortonCode63(unit) >> (3 * (LINEAR_OCTREE_MAX_LEVEL - level));
+  return (1ull << (3 * level)) | code;
+}
+
+BoundingBox LinearOctree::getBoundingBox (uint64_t key) const {
+  int level = getLevel(key);
+  uvec3 cell = decodeMorton63(key ^ (1ull << (3 * level)));
+  vec3 size = (box.maxVals - box.minVals) / float(1ll << level);
+  vec3 minVals = box.minVals + vec3(cell) * size;
+  return BoundingBox(minVals, minVals + size);
+}
+
+// First code at depthCap levels inside the cell key.
+uint64_t LinearOctree::getStart (uint64_t key) const {
+  int level = getLevel(key);
+  return (key ^ (1ull << (3 * level))) << (3 * (depthCap - level));
+}
+
+void LinearOctree::findCells (uint64_t key, int& first, int& last) const {
+  int level = getLevel(key);
+  uint64_t start = getStart(key);
+  uint64_t span = (level >= depthCap) ? 1 : 1ull << (3 * (depthCap - level));
+
+  auto before = [this](uint64_t code, const LinearOctreeCell& cell) {
+    return code < getStart(cell.key);
+  };
+  auto after = [this](const LinearOctreeCell& cell, uint64_t code) {
+    return getStart(cell.key) < code;
+  };
+
+  // A leaf at or above key's level that starts before it may contain it.
+  int around = upper_bound(cells.begin(), cells.end(), start, before) -
+               cells.begin() - 1;
+  if (around >= 0) {
+    const LinearOctreeCell& cell = cells[around];
+    int cellLevel = getLevel(cell.key);
+    if (cellLevel <= level && (key >> (3 * (level - cellLevel))) == cell.key) {
+      first = around;
+      last = around + 1;
+      return;
+    }
+  }
+
+  first = lower_bound(cells.begin(), cells.end(), start, after) -
+          cells.begin();
+  last = lower_bound(cells.begin() + first, cells.end(), start + span,
+                     after) - cells.begin();
+}
+
+int LinearOctree::findCell (const vec3& point) const {
+  if (!box.intersects(point))
+    return -1;
+
+  int first, last;
+  findCells(getKey(point, depthCap), first, last);
+  return (last - first == 1) ? first : -1;
+}
+
+void LinearOctree::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  // Leaves are in depth first order, so ancestors repeat back to back and
+  // only need comparing with the last one emitted at their level.
+  vector<uint64_t> lastAtLevel(depthCap + 1, 0);
+  for (const LinearOctreeCell& cell : cells) {
+    int level = getLevel(cell.key);
+    for (int l = 0; l <= level; l++) {
+      uint64_t ancestor = cell.key >> (3 * (level - l));
+      if (ancestor != lastAtLevel[l]) {
+        lastAtLevel[l] = ancestor;
+        allBoxes.push_back(getBoundingBox(ancestor));
+      }
+    }
+  }
+}
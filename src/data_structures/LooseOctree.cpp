@@ -0,0 +1,172 @@
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/LooseOctree.h"
+#include "helpers/Morton.h"
+
+using namespace std;
+using namespace glm;
+
+LooseOctree::LooseOctree (BoundingBox bbox, float newLooseness,
+                          int newDepthCap) :
+  box(bbox), looseness(newLooseness),
+  depthCap(std::min(std::min(newDepthCap, LINEAR_OCTREE_MAX_LEVEL),
+                    (LOOSE_OCTREE_STACK_SIZE - 1) / 7)),
+  freeList(LOOSE_OCTREE_NULL) {
+  // Same uniform cube as OctTreeNode.
+  float dx = 0.0f;
+  for (int i = 0; i < 3; i++)
+    dx = std::max(dx, (box.maxVals[i] - box.minVals[i]) / 2.0f);
+  for (int i = 0; i < 3; i++)
+    box.maxVals[i] = box.minVals[i] + 2.0f * dx;
+}
+
+int LooseOctree::insert (RigidBody* object) {
+  int proxy;
+  if (freeList == LOOSE_OCTREE_NULL) {
+    proxy = proxies.size();
+    proxies.push_back(LooseOctreeProxy());
+  }
+  else {
+    proxy = freeList;
+    freeList = proxies[proxy].slot;
+  }
+
+  proxies[proxy].object = object;
+  addToCell(proxy, getCellKey(object));
+  return proxy;
+}
+
+void LooseOctree::remove (int proxy) {
+  removeFromCell(proxy);
+  proxies[proxy].object = NULL;
+  proxies[proxy].slot = freeList;
+  freeList = proxy;
+}
+
+bool LooseOctree::move (int proxy) {
+  uint64_t key = getCellKey(proxies[proxy].object);
+  if (key == proxies[proxy].cell)
+    return false;
+
+  removeFromCell(proxy);
+  addToCell(proxy, key);
+  return true;
+}
+
+int LooseOctree::update () {
+  int moved = 0;
+  for (int proxy = 0; proxy < proxies.size(); proxy++) {
+    if (proxies[proxy].object != NULL && move(proxy))
+      moved++;
+  }
+  return moved;
+}
+
+uint64_t LooseOctree::getCellKey (RigidBody* object) const {
+  BoundingBox objectBox = object->getBoundingBox();
+  vec3 center = 0.5f * (objectBox.minVals + objectBox.maxVals);
+  vec3 halfSize = 0.5f * (objectBox.maxVals - objectBox.minVals);
+  float extent = std::max(halfSize.x, std::max(halfSize.y, halfSize.z));
+
+  if (!box.intersects(center))
+    return LINEAR_OCTREE_ROOT;
+
+  // A cell of size s grows by (looseness - 1) / 2 * s on each side, which
+  // has to cover the object's extent past its centre.
+  float size = box.maxVals[0] - box.minVals[0];
+  float slack = 0.5f * (looseness - 1.0f);
+  int level = 0;
+  while (level < depthCap && 0.5f * size * slack >= extent) {
+    size *= 0.5f;
+    level++;
+  }
+
+  uint32_t last = (1u << level) - 1;
+  vec3 cell = (center - box.minVals) / size;
+  uvec3 coords;
+  for (int i = 0; i < 3; i++)
+    coords[i] = std::min(static_cast<uint32_t>(std::max(cell[i], 0.0f)), last);
+
+  return (1ull << (3 * level)) | encodeMorton63(coords);
+}
+
+BoundingBox LooseOctree::getLooseBox (uint64_t key) const {
+  int level = LinearOctree::getLevel(key);
+  uvec3 coords = decodeMorton63(key ^ (1ull << (3 * level)));
+  float size = (box.maxVals[0] - box.minVals[0]) / float(1ll << level);
+
+  vec3 minVals = box.minVals + vec3(coords) * size;
+  vec3 grow(0.5f * (looseness - 1.0f) * size);
+  return BoundingBox(minVals - grow, minVals + size + grow);
+}
+
+void LooseOctree::addToCell (int proxy, uint64_t key) {
+  LooseOctreeCell& cell = cells[key];
+  proxies[proxy].cell = key;
+  proxies[proxy].slot = cell.proxies.size();
+  cell.proxies.push_back(proxy);
+
+  // Counts and child bits up to the root, creating missing ancestors.
+  while (true) {
+    cells[key].count++;
+    if (key == LINEAR_OCTREE_ROOT)
+      break;
+
+    uint64_t parent = LinearOctree::getParent(key);
+    cells[parent].childMask |= 1 << (key & 7);
+    key = parent;
+  }
+}
+
+void LooseOctree::removeFromCell (int proxy) {
+  uint64_t key = proxies[proxy].cell;
+  LooseOctreeCell& cell = cells[key];
+
+  // Swap with the last proxy of the cell.
+  int slot = proxies[proxy].slot;
+  int last = cell.proxies.back();
+  cell.proxies[slot] = last;
+  proxies[last].slot = slot;
+  cell.proxies.pop_back();
+
+  // Drop cells left empty on the way to the root.
+  while (true) {
+    LooseOctreeCell& current = cells[key];
+    current.count--;
+
+    bool empty = (current.count == 0);
+    if (empty)
+      cells.erase(key);
+
+    if (key == LINEAR_OCTREE_ROOT)
+      break;
+
+    uint64_t parent = LinearOctree::getParent(key);
+    if (empty)
+      cells[parent].childMask &= ~(1 << (key & 7));
+    key = parent;
+  }
+}
+
+void LooseOctree::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  for (const auto& entry : cells)
+    allBoxes.push_back(getLooseBox(entry.first));
+}
+
+void LooseOctree::getOverlappingPairs (vector<RigidBodyPair>& pairs) const {
+  for (int proxy = 0; proxy < proxies.size(); proxy++) {
+    RigidBody* object = proxies[proxy].object;
+    if (object == NULL)
+      continue;
+
+    // Each pair is reported from its lower proxy only.
+    queryBox(object->getBoundingBox(), [&](int other) {
+      if (other > proxy)
+        pairs.push_back(RigidBodyPair(object, proxies[other].object));
+    });
+  }
+}
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/MeshBVH.h"
+#include "helpers/Parallel.h"
+
+#define FACE_EPSILON 1e-9f
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Whether the edge or vertex the hit is on also belongs to face. Corners
+// are matched by position so unwelded meshes work too. A hit inside its
+// face, away from the edges, is on no other face.
+bool isOnFace (const MeshBVH& mesh, const MeshHit& hit, int face) {
+  float weights[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+  const uvec3& corners = mesh.faces[hit.face];
+  const uvec3& other = mesh.faces[face];
+
+  bool onEdge = false;
+  for (int i = 0; i < 3; ++i) {
+    if (weights[i] < MESH_EDGE_EPSILON) {
+      onEdge = true;
+      continue;
+    }
+
+    bool shared = false;
+    for (int j = 0; j < 3; ++j)
+      shared = shared || mesh.vertices[corners[i]] == mesh.vertices[other[j]];
+    if (!shared)
+      return false;
+  }
+  return onEdge;
+}
+
+} // End anonymous namespace for hit deduplication helpers.
+
+MeshBVH::MeshBVH (const vector<vec4>& meshVertices,
+                  const vector<uvec3>& meshFaces,
+                  BVHSplitMethod method) :
+  faces(meshFaces) {
+  vertices.resize(meshVertices.size());
+  for (int i = 0; i < meshVertices.size(); ++i)
+    vertices[i] = vec3(meshVertices[i]);
+
+  build(method);
+}
+
+MeshBVH::MeshBVH (const vector<vec4>& meshVertices,
+                  const vector<uvec3>& meshFaces,
+                  const string& cachePath, BVHSplitMethod method) :
+  faces(meshFaces) {
+  vertices.resize(meshVertices.size());
+  for (int i = 0; i < meshVertices.size(); ++i)
+    vertices[i] = vec3(meshVertices[i]);
+
+  uint64_t key = getMeshBVHKey(meshVertices, meshFaces, method);
+  if (load(cachePath, key))
+    return;
+
+  build(method);
+  save(cachePath, key);
+}
+
+void MeshBVH::build (BVHSplitMethod method) {
+  vector<BoundingBox> boxes(faces.size());
+  vector<vec3> centroids(faces.size());
+  parallelFor(0, faces.size(), [&](int i) {
+    const uvec3& face = faces[i];
+    vec3 a = vertices[face[0]];
+    vec3 b = vertices[face[1]];
+    vec3 c = vertices[face[2]];
+    boxes[i] = BoundingBox(min(a, min(b, c)), max(a, max(b, c)));
+    centroids[i] = (a + b + c) / 3.0f;
+  });
+
+  buildLinearBVHNodes(boxes, centroids, method, nodes, triangles);
+}
+
+void MeshBVH::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  for (const LinearBVHNode& node : nodes)
+    allBoxes.push_back(node.getBoundingBox());
+}
+
+bool MeshBVH::intersectsFace (const Ray& ray, int face, float tMin, float tMax,
+                              MeshHit& hit) const {
+  const vec3& a = vertices[faces[face][0]];
+  const vec3& b = vertices[faces[face][1]];
+  const vec3& c = vertices[faces[face][2]];
+
+  vec3 e1 = b - a;
+  vec3 e2 = c - a;
+  vec3 p = cross(ray.direction, e2);
+  float det = dot(e1, p);
+
+  // Ray parallel to the face.
+  if (std::abs(det) < FACE_EPSILON)
+    return false;
+
+  float invDet = 1.0f / det;
+  vec3 s = ray.position - a;
+  float u = dot(s, p) * invDet;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+
+  vec3 q = cross(s, e1);
+  float v = dot(ray.direction, q) * invDet;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+
+  float t = dot(e2, q) * invDet;
+  if (t <= tMin || t >= tMax)
+    return false;
+
+  hit.face = face;
+  hit.timeHit = t;
+  hit.u = u;
+  hit.v = v;
+  hit.hit = true;
+  return true;
+}
+
+bool MeshBVH::getIntersection (const Ray& ray, MeshHit& hit,
+                               float tMin, float tMax) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  bool result = false;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    float tNear;
+    if (!node.intersects(ray, tMax, tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      // Every hit shrinks tMax so the closest one wins.
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        if (intersectsFace(ray, triangles[i], tMin, tMax, hit)) {
+          tMax = hit.timeHit;
+          result = true;
+        }
+      }
+    }
+    // Visit the child on the near side of the split first.
+    else if (ray.direction[node.axis] < 0.0f) {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = index + 1;
+      stack[top++] = node.offset;
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return result;
+}
+
+int MeshBVH::getAllIntersections (const Ray& ray, vector<MeshHit>& hits,
+                                  bool sorted, bool dedupe,
+                                  float tMin, float tMax) const {
+  if (nodes.empty())
+    return 0;
+
+  int first = hits.size();
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  MeshHit hit;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    float tNear;
+    if (!node.intersects(ray, tMax, tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        if (intersectsFace(ray, triangles[i], tMin, tMax, hit))
+          hits.push_back(hit);
+      }
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  if (sorted || dedupe) {
+    std::sort(hits.begin() + first, hits.end(),
+              [](const MeshHit& a, const MeshHit& b) {
+                return a.timeHit < b.timeHit;
+              });
+  }
+
+  if (dedupe && hits.size() > first) {
+    float length = glm::length(ray.direction);
+    int last = first;
+    for (int i = first + 1; i < hits.size(); ++i) {
+      // Many faces can share a vertex, so check every kept hit at about
+      // the same distance and not only the last one.
+      bool repeated = false;
+      for (int j = last; j >= first && !repeated; --j) {
+        float along = std::max(std::abs(hits[i].timeHit),
+                               std::abs(hits[j].timeHit)) * length;
+        float gap = (hits[i].timeHit - hits[j].timeHit) * length;
+        if (gap > MESH_HIT_EPSILON * std::max(along, 1.0f))
+          break;
+
+        repeated = isOnFace(*this, hits[i], hits[j].face) &&
+                   isOnFace(*this, hits[j], hits[i].face);
+      }
+      if (!repeated)
+        hits[++last] = hits[i];
+    }
+    hits.resize(last + 1);
+  }
+
+  return hits.size() - first;
+}
+
+bool MeshBVH::isOccluded (const Ray& ray, float tMin, float tMax) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  MeshHit hit;
+
+  while (top > 0) {
+    int index = stack[--top];
+    const LinearBVHNode& node = nodes[index];
+
+    float tNear;
+    if (!node.intersects(ray, tMax, tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        if (intersectsFace(ray, triangles[i], tMin, tMax, hit))
+          return true;
+      }
+    }
+    else if (ray.direction[node.axis] < 0.0f) {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = index + 1;
+      stack[top++] = node.offset;
+    }
+    else {
+      assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+
+  return false;
+}
+
+void MeshBVH::isOccluded (const vector<Ray>& rays, vector<uint8_t>& occluded,
+                          float tMin, float tMax) const {
+  occluded.resize(rays.size());
+  parallelFor(0, rays.size(), [&](int i) {
+    occluded[i] = isOccluded(rays[i], tMin, tMax);
+  });
+}
+
+bool MeshBVH::getNearest (const vec3& point, NearestHit& nearest) const {
+  if (nodes.empty())
+    return false;
+
+  struct Entry {
+    int index;
+    float distance2;
+  };
+
+  Entry stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = { 0, nodes[0].getBoundingBox().getDistance2(point) };
+
+  bool result = false;
+
+  while (top > 0) {
+    Entry entry = stack[--top];
+
+    // The search radius may have shrunk since this was pushed.
+    if (entry.distance2 >= nearest.distance2)
+      continue;
+
+    const LinearBVHNode& node = nodes[entry.index];
+    if (node.isLeaf()) {
+      for (int i = node.offset; i < node.offset + node.count; ++i) {
+        const uvec3& face = faces[triangles[i]];
+        vec3 closest = closestPointOnTriangle(point, vertices[face[0]],
+                                              vertices[face[1]],
+                                              vertices[face[2]]);
+        vec3 offset = closest - point;
+        float distance2 = dot(offset, offset);
+        if (distance2 < nearest.distance2) {
+          nearest.point = closest;
+          nearest.distance2 = distance2;
+          nearest.primitive = triangles[i];
+          nearest.hit = true;
+          result = true;
+        }
+      }
+      continue;
+    }
+
+    int left = entry.index + 1;
+    int right = node.offset;
+    Entry near = { left, nodes[left].getBoundingBox().getDistance2(point) };
+    Entry far = { right, nodes[right].getBoundingBox().getDistance2(point) };
+    if (far.distance2 < near.distance2)
+      std::swap(near, far);
+
+    assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+    if (far.distance2 < nearest.distance2)
+      stack[top++] = far;
+    if (near.distance2 < nearest.distance2)
+      stack[top++] = near;
+  }
+
+  return result;
+}
+
+void MeshBVH::getNearest (const vector<vec3>& points,
+                          vector<NearestHit>& nearest,
+                          float maxDistance) const {
+  nearest.assign(points.size(), NearestHit(maxDistance));
+  parallelFor(0, points.size(), [&](int i) {
+    getNearest(points[i], nearest[i]);
+  });
+}
@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/MeshBVH.h"
+#include "data_structures/BVHSplit.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+const char CACHE_MAGIC[4] = { 'M', 'B', 'V', 'H' };
+
+// Fixed 32 byte header so the node array that follows stays aligned.
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t nodeCount;
+  uint32_t triangleCount;
+  uint32_t nodeSize;
+  uint32_t padding;
+};
+
+uint64_t hashBytes (uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+} // End anonymous namespace for mesh BVH cache helpers.
+
+uint64_t getMeshBVHKey (const vector<vec4>& meshVertices,
+                        const vector<uvec3>& meshFaces,
+                        BVHSplitMethod method) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  if (!meshVertices.empty())
+    hash = hashBytes(hash, &meshVertices[0], meshVertices.size() * sizeof(vec4));
+  if (!meshFaces.empty())
+    hash = hashBytes(hash, &meshFaces[0], meshFaces.size() * sizeof(uvec3));
+
+  // Anything that changes the built tree has to change the key. Changes
+  // to the build code itself bump MESH_BVH_CACHE_VERSION instead.
+  uint32_t params[8] = { (uint32_t)method, SAH_BINS, BVH_LEAF_CAP,
+                         BVH_DEPTH_CAP, BVH_SAH_DEPTH_CAP,
+                         LINEAR_BVH_MAX_LEAF_SIZE,
+                         (uint32_t)meshVertices.size(),
+                         (uint32_t)meshFaces.size() };
+  float costs[2] = { SAH_TRAVERSAL_COST, SAH_INTERSECT_COST };
+  hash = hashBytes(hash, params, sizeof(params));
+  hash = hashBytes(hash, costs, sizeof(costs));
+  return hash;
+}
+
+bool MeshBVH::save (const string& path, uint64_t key) const {
+  CacheHeader header;
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = MESH_BVH_CACHE_VERSION;
+  header.key = key;
+  header.nodeCount = nodes.size();
+  header.triangleCount = triangles.size();
+  header.nodeSize = sizeof(LinearBVHNode);
+  header.padding = 0;
+
+  // Write to the side and rename so readers never see a partial file.
+  string tmpPath = path + ".tmp";
+  bool written;
+  {
+    ofstream ofs(tmpPath, ios::binary | ios::trunc);
+    if (!ofs)
+      return false;
+    ofs.write((const char*)&header, sizeof(header));
+    if (!nodes.empty())
+      ofs.write((const char*)&nodes[0], nodes.size() * sizeof(LinearBVHNode));
+    if (!triangles.empty())
+      ofs.write((const char*)&triangles[0], triangles.size() * sizeof(int));
+    ofs.close();
+    written = !ofs.fail();
+  }
+
+  // Never leave a partial file behind.
+  if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool MeshBVH::load (const string& path, uint64_t key) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = st.st_size;
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+
+  const char* data = (const char*)mapped;
+  CacheHeader header;
+  memcpy(&header, data, sizeof(header));
+
+  size_t nodeBytes = (size_t)header.nodeCount * sizeof(LinearBVHNode);
+  size_t triangleBytes = (size_t)header.triangleCount * sizeof(int);
+
+  bool valid =
+    memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+    header.version == MESH_BVH_CACHE_VERSION &&
+    header.key == key &&
+    header.nodeSize == sizeof(LinearBVHNode) &&
+    header.triangleCount == faces.size() &&
+    size == sizeof(header) + nodeBytes + triangleBytes;
+
+  if (valid) {
+    // The file holds the arrays exactly as laid out in memory.
+    nodes.resize(header.nodeCount);
+    triangles.resize(header.triangleCount);
+    if (nodeBytes > 0)
+      memcpy(&nodes[0], data + sizeof(header), nodeBytes);
+    if (triangleBytes > 0)
+      memcpy(&triangles[0], data + sizeof(header) + nodeBytes, triangleBytes);
+  }
+
+  munmap(mapped, size);
+  return valid;
+}
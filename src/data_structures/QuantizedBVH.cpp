@@ -0,0 +1,281 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "data_structures/QuantizedBVH.h"
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Grid step per axis within a parent box, padded by a few ulps so the
+// last grid line never falls short of the parent's max.
+template <typename T>
+float getScale () {
+  return (1.0f / numeric_limits<T>::max()) * (1.0f + 1e-6f);
+}
+
+template <typename T>
+vec3 getStep (const BoundingBox& parent) {
+  return (parent.maxVals - parent.minVals) * getScale<T>();
+}
+
+template <typename T>
+BoundingBox decode (const BoundingBox& parent, const vec3& step,
+                    const T* qMin, const T* qMax) {
+  BoundingBox box;
+  box.isEmpty = false;
+  for (int i = 0; i < 3; ++i) {
+    box.minVals[i] = parent.minVals[i] + qMin[i] * step[i];
+    box.maxVals[i] = parent.minVals[i] + qMax[i] * step[i];
+  }
+  return box;
+}
+
+// Rounds down for min and up for max, then nudges until the decoded box
+// really contains the exact one despite float error.
+template <typename T>
+void encode (const BoundingBox& parent, const vec3& step,
+             const BoundingBox& box, T* qMin, T* qMax) {
+  int levels = numeric_limits<T>::max();
+  for (int i = 0; i < 3; ++i) {
+    if (step[i] <= 0.0f) {
+      qMin[i] = 0;
+      qMax[i] = 0;
+      continue;
+    }
+
+    float origin = parent.minVals[i];
+    int lo = floor((box.minVals[i] - origin) / step[i]);
+    int hi = ceil((box.maxVals[i] - origin) / step[i]);
+    lo = std::max(0, std::min(levels, lo));
+    hi = std::max(0, std::min(levels, hi));
+
+    while (lo > 0 && origin + lo * step[i] > box.minVals[i])
+      lo--;
+    while (hi < levels && origin + hi * step[i] < box.maxVals[i])
+      hi++;
+
+    qMin[i] = lo;
+    qMax[i] = hi;
+  }
+}
+
+uint32_t makeLeaf (const LinearBVHNode& node) {
+  assert(node.offset <= QUANTIZED_MAX_OFFSET);
+  return QUANTIZED_LEAF_BIT | (node.offset << QUANTIZED_COUNT_BITS) | node.count;
+}
+
+bool isLeafRef (uint32_t ref) {
+  return (ref & QUANTIZED_LEAF_BIT) != 0;
+}
+
+int getLeafOffset (uint32_t ref) {
+  return (ref & ~QUANTIZED_LEAF_BIT) >> QUANTIZED_COUNT_BITS;
+}
+
+int getLeafCount (uint32_t ref) {
+  return ref & ((1u << QUANTIZED_COUNT_BITS) - 1);
+}
+
+bool intersectsBox (const BoundingBox& box, const Ray& ray, float tMax) {
+  float tMin = 0.0f;
+  for (int i = 0; i < 3; ++i) {
+    float t1 = (box.minVals[i] - ray.position[i]) * ray.invDirection[i];
+    float t2 = (box.maxVals[i] - ray.position[i]) * ray.invDirection[i];
+    tMin = std::max(tMin, std::min(t1, t2));
+    tMax = std::min(tMax, std::max(t1, t2));
+  }
+  return tMin <= tMax;
+}
+
+// Encodes the subtree of the interior linear node at index, given the
+// conservative box its parent decoded for it. Returns the new node index.
+template <typename T>
+uint32_t compress (const vector<LinearBVHNode>& linear, int index,
+                   const BoundingBox& box,
+                   vector<QuantizedBVHNode<T> >& nodes) {
+  uint32_t result = nodes.size();
+  nodes.push_back(QuantizedBVHNode<T>());
+
+  vec3 step = getStep<T>(box);
+  int children[2] = { index + 1, (int)linear[index].offset };
+
+  for (int c = 0; c < 2; ++c) {
+    const LinearBVHNode& child = linear[children[c]];
+
+    T qMin[3];
+    T qMax[3];
+    encode<T>(box, step, child.getBoundingBox(), qMin, qMax);
+
+    uint32_t ref;
+    if (child.isLeaf())
+      ref = makeLeaf(child);
+    else
+      ref = compress<T>(linear, children[c], decode<T>(box, step, qMin, qMax),
+                        nodes);
+
+    // The vector may have grown, so index it again.
+    QuantizedBVHNode<T>& node = nodes[result];
+    for (int i = 0; i < 3; ++i) {
+      node.childMin[c][i] = qMin[i];
+      node.childMax[c][i] = qMax[i];
+    }
+    node.child[c] = ref;
+  }
+
+  return result;
+}
+
+} // End anonymous namespace for quantization helpers.
+
+template <typename T>
+QuantizedBVH<T>::QuantizedBVH (const MeshBVH& source) :
+  mesh(&source), root(0) {
+  if (source.nodes.empty())
+    return;
+
+  const LinearBVHNode& top = source.nodes[0];
+  rootBox = top.getBoundingBox();
+
+  if (top.isLeaf()) {
+    root = makeLeaf(top);
+    return;
+  }
+
+  nodes.reserve(source.nodes.size() / 2);
+  root = compress<T>(source.nodes, 0, rootBox, nodes);
+}
+
+template <typename T>
+size_t QuantizedBVH<T>::getMemoryUsage () const {
+  return nodes.size() * sizeof(QuantizedBVHNode<T>) + sizeof(BoundingBox);
+}
+
+template <typename T>
+void QuantizedBVH<T>::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  if (mesh->nodes.empty())
+    return;
+
+  struct Entry {
+    uint32_t ref;
+    BoundingBox box;
+  };
+
+  vector<Entry> stack;
+  stack.push_back({ root, rootBox });
+
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    allBoxes.push_back(entry.box);
+
+    if (isLeafRef(entry.ref))
+      continue;
+
+    const QuantizedBVHNode<T>& node = nodes[entry.ref];
+    vec3 step = getStep<T>(entry.box);
+    for (int c = 0; c < 2; ++c) {
+      BoundingBox box = decode<T>(entry.box, step, node.childMin[c],
+                                  node.childMax[c]);
+      stack.push_back({ node.child[c], box });
+    }
+  }
+}
+
+template <typename T>
+bool QuantizedBVH<T>::getIntersection (const Ray& ray, MeshHit& hit,
+                                       float tMin, float tMax) const {
+  if (mesh->nodes.empty() || !intersectsBox(rootBox, ray, tMax))
+    return false;
+
+  // Each entry carries its decoded box, which its children are relative
+  // to. Plain floats keep the stack small and the decode cheap.
+  struct Entry {
+    uint32_t ref;
+    float minVals[3];
+    float maxVals[3];
+  };
+
+  float scale = getScale<T>();
+
+  Entry stack[LINEAR_BVH_STACK_SIZE];
+  int top = 0;
+  stack[top].ref = root;
+  for (int i = 0; i < 3; ++i) {
+    stack[top].minVals[i] = rootBox.minVals[i];
+    stack[top].maxVals[i] = rootBox.maxVals[i];
+  }
+  top++;
+
+  bool result = false;
+
+  while (top > 0) {
+    const Entry entry = stack[--top];
+
+    if (isLeafRef(entry.ref)) {
+      int offset = getLeafOffset(entry.ref);
+      int count = getLeafCount(entry.ref);
+      for (int i = offset; i < offset + count; ++i) {
+        if (mesh->intersectsFace(ray, mesh->triangles[i], tMin, tMax, hit)) {
+          tMax = hit.timeHit;
+          result = true;
+        }
+      }
+      continue;
+    }
+
+    const QuantizedBVHNode<T>& node = nodes[entry.ref];
+
+    // Same arithmetic as getStep and decode, inlined.
+    float step[3];
+    for (int i = 0; i < 3; ++i)
+      step[i] = (entry.maxVals[i] - entry.minVals[i]) * scale;
+
+    Entry children[2];
+    bool hits[2];
+    for (int c = 0; c < 2; ++c) {
+      children[c].ref = node.child[c];
+      float tNear = 0.0f;
+      float tFar = tMax;
+      for (int i = 0; i < 3; ++i) {
+        float lo = entry.minVals[i] + node.childMin[c][i] * step[i];
+        float hi = entry.minVals[i] + node.childMax[c][i] * step[i];
+        children[c].minVals[i] = lo;
+        children[c].maxVals[i] = hi;
+
+        float t1 = (lo - ray.position[i]) * ray.invDirection[i];
+        float t2 = (hi - ray.position[i]) * ray.invDirection[i];
+        tNear = std::max(tNear, std::min(t1, t2));
+        tFar = std::min(tFar, std::max(t1, t2));
+      }
+      hits[c] = tNear <= tFar;
+    }
+
+    // Push the far child first so the one nearer along the ray pops next.
+    float along = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      float between = (children[1].minVals[i] + children[1].maxVals[i]) -
+                      (children[0].minVals[i] + children[0].maxVals[i]);
+      along += between * ray.direction[i];
+    }
+    int first = (along < 0.0f) ? 1 : 0;
+
+    assert(top + 2 <= LINEAR_BVH_STACK_SIZE);
+    if (hits[1 - first])
+      stack[top++] = children[1 - first];
+    if (hits[first])
+      stack[top++] = children[first];
+  }
+
+  return result;
+}
+
+template struct QuantizedBVH<uint8_t>;
+template struct QuantizedBVH<uint16_t>;
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "data_structures/TreeStats.h"
+#include "data_structures/BVHSplit.h"
+
+using namespace std;
+
+namespace {
+
+float getOverlapVolume (const BoundingBox& a, const BoundingBox& b) {
+  float volume = 1.0f;
+  for (int i = 0; i < 3; ++i) {
+    float extent = std::min(a.maxVals[i], b.maxVals[i]) -
+                   std::max(a.minVals[i], b.minVals[i]);
+    if (extent <= 0.0f)
+      return 0.0f;
+    volume *= extent;
+  }
+  return volume;
+}
+
+void writeArray (ostringstream& os, const vector<int>& values) {
+  os << "[";
+  for (int i = 0; i < values.size(); ++i)
+    os << (i > 0 ? ", " : "") << values[i];
+  os << "]";
+}
+
+} // End anonymous namespace for tree statistics helpers.
+
+TreeStats::TreeStats () :
+  nodeCount(0), leafCount(0), objectCount(0), maxDepth(0), sahCost(0.0f),
+  overlapVolume(0.0f), memoryBytes(0) { }
+
+void TreeStats::addNode (int depth, const BoundingBox& box, bool isLeaf,
+                         int objects, size_t bytes) {
+  nodeCount++;
+  maxDepth = std::max(maxDepth, depth);
+  memoryBytes += bytes;
+
+  if (depthHistogram.size() <= depth)
+    depthHistogram.resize(depth + 1, 0);
+  depthHistogram[depth]++;
+
+  float area = box.getSurfaceArea();
+  if (!isLeaf) {
+    sahCost += area * SAH_TRAVERSAL_COST;
+    return;
+  }
+
+  leafCount++;
+  objectCount += objects;
+  sahCost += area * SAH_INTERSECT_COST * objects;
+
+  if (occupancyHistogram.size() <= objects)
+    occupancyHistogram.resize(objects + 1, 0);
+  occupancyHistogram[objects]++;
+}
+
+void TreeStats::addSiblings (const BoundingBox& a, const BoundingBox& b) {
+  overlapVolume += getOverlapVolume(a, b);
+}
+
+void TreeStats::finish (const BoundingBox& root) {
+  float rootArea = root.getSurfaceArea();
+  sahCost = (rootArea > 0.0f) ? sahCost / rootArea : 0.0f;
+}
+
+string TreeStats::toJSON () const {
+  ostringstream os;
+  os << "{";
+  os << "\"nodeCount\": " << nodeCount << ", ";
+  os << "\"leafCount\": " << leafCount << ", ";
+  os << "\"objectCount\": " << objectCount << ", ";
+  os << "\"maxDepth\": " << maxDepth << ", ";
+  os << "\"sahCost\": " << sahCost << ", ";
+  os << "\"overlapVolume\": " << overlapVolume << ", ";
+  os << "\"memoryBytes\": " << memoryBytes << ", ";
+  os << "\"depthHistogram\": ";
+  writeArray(os, depthHistogram);
+  os << ", \"occupancyHistogram\": ";
+  writeArray(os, occupancyHistogram);
+  os << "}";
+  return os.str();
+}
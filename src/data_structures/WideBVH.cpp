@@ -0,0 +1,306 @@
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "data_structures/WideBVH.h"
+#include "data_structures/LinearBVH.h"
+#include "geometry/Sphere.h"
+#include "physics/Intersection.h"
+#include "physics/RigidBody.h"
+
+#define MAX_DEPTH 64
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Pulls the largest interior grandchildren up until the node has N slots.
+template <int N>
+int collapse (const LinearBVH& bvh, vector<WideBVHNode<N> >& nodes, int binary) {
+  int children[N];
+  int numChildren = 0;
+
+  const LinearBVHNode& root = bvh.nodes[binary];
+  if (root.isLeaf()) {
+    children[numChildren++] = binary;
+  }
+  else {
+    children[numChildren++] = binary + 1;
+    children[numChildren++] = root.offset;
+  }
+
+  while (numChildren < N) {
+    int best = -1;
+    float bestArea = -1.0f;
+    for (int i = 0; i < numChildren; ++i) {
+      const LinearBVHNode& node = bvh.nodes[children[i]];
+      float area = node.getBoundingBox().getSurfaceArea();
+      if (!node.isLeaf() && area > bestArea) {
+        best = i;
+        bestArea = area;
+      }
+    }
+
+    if (best < 0)
+      break;
+
+    int expand = children[best];
+    children[best] = expand + 1;
+    children[numChildren++] = bvh.nodes[expand].offset;
+  }
+
+  int index = nodes.size();
+  nodes.push_back(WideBVHNode<N>());
+
+  for (int i = 0; i < numChildren; ++i) {
+    const LinearBVHNode& node = bvh.nodes[children[i]];
+    nodes[index].setBoundingBox(i, node.getBoundingBox());
+
+    if (node.isLeaf()) {
+      nodes[index].child[i] = node.offset;
+      nodes[index].count[i] = node.count;
+    }
+    else {
+      int child = collapse(bvh, nodes, children[i]);
+      nodes[index].child[i] = child;
+    }
+  }
+
+  return index;
+}
+
+// Bit i is set when the ray enters child i before tMax, tNear gets the
+// entry distances.
+template <int N>
+int intersectChildren (const WideBVHNode<N>& node, const Ray& ray,
+                       float tMax, float* tNear) {
+  const float* mins[3] = { node.minX, node.minY, node.minZ };
+  const float* maxs[3] = { node.maxX, node.maxY, node.maxZ };
+
+#if defined(__SSE__)
+  int mask = 0;
+  int lane = 0;
+
+#if defined(__AVX__)
+  for (; lane + 8 <= N; lane += 8) {
+    __m256 near = _mm256_setzero_ps();
+    __m256 far = _mm256_set1_ps(tMax);
+
+    for (int i = 0; i < 3; ++i) {
+      __m256 o = _mm256_set1_ps(ray.position[i]);
+      __m256 inv = _mm256_set1_ps(ray.invDirection[i]);
+      __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(mins[i] + lane), o), inv);
+      __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(maxs[i] + lane), o), inv);
+      near = _mm256_max_ps(near, _mm256_min_ps(t1, t2));
+      far = _mm256_min_ps(far, _mm256_max_ps(t1, t2));
+    }
+
+    _mm256_storeu_ps(tNear + lane, near);
+    mask |= _mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ)) << lane;
+  }
+#endif
+
+  for (; lane < N; lane += 4) {
+    __m128 near = _mm_setzero_ps();
+    __m128 far = _mm_set1_ps(tMax);
+
+    for (int i = 0; i < 3; ++i) {
+      __m128 o = _mm_set1_ps(ray.position[i]);
+      __m128 inv = _mm_set1_ps(ray.invDirection[i]);
+      __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mins[i] + lane), o), inv);
+      __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxs[i] + lane), o), inv);
+      near = _mm_max_ps(near, _mm_min_ps(t1, t2));
+      far = _mm_min_ps(far, _mm_max_ps(t1, t2));
+    }
+
+    _mm_storeu_ps(tNear + lane, near);
+    mask |= _mm_movemask_ps(_mm_cmple_ps(near, far)) << lane;
+  }
+
+  return mask;
+#else
+  int mask = 0;
+  for (int lane = 0; lane < N; ++lane) {
+    float near = 0.0f;
+    float far = tMax;
+    for (int i = 0; i < 3; ++i) {
+      float t1 = (mins[i][lane] - ray.position[i]) * ray.invDirection[i];
+      float t2 = (maxs[i][lane] - ray.position[i]) * ray.invDirection[i];
+      near = std::max(near, std::min(t1, t2));
+      far = std::min(far, std::max(t1, t2));
+    }
+    tNear[lane] = near;
+    if (near <= far)
+      mask |= 1 << lane;
+  }
+  return mask;
+#endif
+}
+
+// Bit i is set when the sphere overlaps child i.
+template <int N>
+int intersectChildren (const WideBVHNode<N>& node, const Sphere& obj) {
+  const float* mins[3] = { node.minX, node.minY, node.minZ };
+  const float* maxs[3] = { node.maxX, node.maxY, node.maxZ };
+  float radius2 = obj.radius * obj.radius;
+
+#if defined(__SSE__)
+  int mask = 0;
+  for (int lane = 0; lane < N; lane += 4) {
+    __m128 dist2 = _mm_setzero_ps();
+    for (int i = 0; i < 3; ++i) {
+      __m128 c = _mm_set1_ps(obj.position[i]);
+      __m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(mins[i] + lane), c), _mm_setzero_ps());
+      __m128 above = _mm_max_ps(_mm_sub_ps(c, _mm_loadu_ps(maxs[i] + lane)), _mm_setzero_ps());
+      __m128 d = _mm_add_ps(below, above);
+      dist2 = _mm_add_ps(dist2, _mm_mul_ps(d, d));
+    }
+    mask |= _mm_movemask_ps(_mm_cmplt_ps(dist2, _mm_set1_ps(radius2))) << lane;
+  }
+  return mask;
+#else
+  int mask = 0;
+  for (int lane = 0; lane < N; ++lane) {
+    float dist2 = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      float d = std::max(mins[i][lane] - obj.position[i], 0.0f) +
+                std::max(obj.position[i] - maxs[i][lane], 0.0f);
+      dist2 += d * d;
+    }
+    if (dist2 < radius2)
+      mask |= 1 << lane;
+  }
+  return mask;
+#endif
+}
+
+} // End anonymous namespace for collapsing and SIMD child tests.
+
+template <int N>
+WideBVH<N>::WideBVH (const LinearBVH& bvh) :
+  primitives(bvh.primitives), objects(bvh.objects) {
+  if (bvh.nodes.empty())
+    return;
+  collapse(bvh, nodes, 0);
+  nodes.shrink_to_fit();
+}
+
+template <int N>
+void WideBVH<N>::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  for (const WideBVHNode<N>& node : nodes) {
+    for (int i = 0; i < N; ++i) {
+      if (node.child[i] >= 0)
+        allBoxes.push_back(node.getBoundingBox(i));
+    }
+  }
+}
+
+template <int N>
+bool WideBVH<N>::getIntersection (const Sphere& obj, Intersection& isect) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[MAX_DEPTH * N];
+  int top = 0;
+  stack[top++] = 0;
+
+  Intersection tmp;
+
+  while (top > 0) {
+    const WideBVHNode<N>& node = nodes[stack[--top]];
+    int mask = intersectChildren(node, obj);
+
+    for (int i = 0; i < N; ++i) {
+      if ((mask & (1 << i)) == 0 || node.child[i] < 0)
+        continue;
+
+      if (node.count[i] == 0) {
+        stack[top++] = node.child[i];
+        continue;
+      }
+
+      for (int j = node.child[i]; j < node.child[i] + node.count[i]; ++j) {
+        RigidBody* rigid = objects[primitives[j]];
+        if (rigid == &obj)
+          continue;
+        if (obj.intersects(rigid->getBoundingBox(), tmp)) {
+          isect.hit = true;
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+template <int N>
+bool WideBVH<N>::getIntersection (const Ray& ray, Intersection& isect) const {
+  if (nodes.empty())
+    return false;
+
+  int stack[MAX_DEPTH * N];
+  float stackNear[MAX_DEPTH * N];
+  int top = 0;
+  stack[top] = 0;
+  stackNear[top++] = 0.0f;
+
+  bool result = false;
+
+  while (top > 0) {
+    --top;
+    float tMax = isect.hit ? isect.timeHit : INF;
+    if (stackNear[top] > tMax)
+      continue;
+
+    const WideBVHNode<N>& node = nodes[stack[top]];
+
+    float tNear[N];
+    int mask = intersectChildren(node, ray, tMax, tNear);
+
+    // Interior children hit, sorted so the nearest is pushed last.
+    int order[N];
+    int numOrder = 0;
+
+    for (int i = 0; i < N; ++i) {
+      if ((mask & (1 << i)) == 0 || node.child[i] < 0)
+        continue;
+
+      if (node.count[i] == 0) {
+        int j = numOrder++;
+        while (j > 0 && tNear[order[j - 1]] < tNear[i]) {
+          order[j] = order[j - 1];
+          --j;
+        }
+        order[j] = i;
+        continue;
+      }
+
+      for (int j = node.child[i]; j < node.child[i] + node.count[i]; ++j) {
+        Intersection rigidIsect;
+        if (objects[primitives[j]]->intersects(ray, rigidIsect)) {
+          result = true;
+          if (isect.hit == false || isect.timeHit > rigidIsect.timeHit)
+            isect = rigidIsect;
+        }
+      }
+    }
+
+    for (int i = 0; i < numOrder; ++i) {
+      stack[top] = node.child[order[i]];
+      stackNear[top++] = tNear[order[i]];
+    }
+  }
+
+  return result;
+}
+
+template struct WideBVH<4>;
+template struct WideBVH<8>;
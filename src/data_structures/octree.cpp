@@ -1,16 +1,21 @@
+#include <algorithm>
 #include <vector>
 #include <set>
 #include <iostream>
 #include <cstdlib>
 #include <time.h>
+#include <thread>
 
 #include "data_structures/octree.h"
 #include "geometry/Sphere.h"
 #include "physics/RigidBody.h"
 #include "geometry/BoundingBox.h"
+#include "helpers/Parallel.h"
 
 using namespace std;
 
+#define PARALLEL_BUILD_CUTOFF 4096
+
 const int LEAF_CAP = 5;
 const int DEPTH_CAP = 4;
 
@@ -30,7 +35,7 @@ OctTreeNode::OctTreeNode (const vector<RigidBody*>& objects, int level,
       dx = max(dx, (this->box.maxVals[i] - this->box.minVals[i]) / 2.0f);
 
     for (int i = 0; i < 3; i++)
-      this->box.maxVals[i] = this->box.minVals[i] + dx;
+      this->box.maxVals[i] = this->box.minVals[i] + 2.0f * dx;
   }
 
   // Make sure bounds are uniform.
@@ -44,6 +49,7 @@ OctTreeNode::OctTreeNode (const vector<RigidBody*>& objects, int level,
   if (objects.size() <= LEAF_CAP || level > DEPTH_CAP) {
     for (RigidBody *object : objects)
       this->objects.push_back(object);
+    sumAggregate();
     return;
   }
 
@@ -60,33 +66,201 @@ OctTreeNode::OctTreeNode (const vector<RigidBody*>& objects, int level,
     }
   }
 
+  // One pass, each object goes to exactly one octant with points on a
+  // split plane sent to the upper side. The neighbour queries count on
+  // objects never being stored twice.
+  glm::vec3 mid = box.minVals + dx;
   for (RigidBody *obj : objects) {
+    const glm::vec3& p = obj->position;
+    int octant = ((p.x >= mid.x) << 2) | ((p.y >= mid.y) << 1) | (p.z >= mid.z);
+    items[octant].push_back(obj);
+  }
+
+  // Large nodes near the top build their children on separate threads.
+  if (objects.size() > PARALLEL_BUILD_CUTOFF &&
+      level < getParallelDepth(8)) {
+    vector<thread> threads;
+    for (int i = 0; i < 8; i++) {
+      if (items[i].size() > 0) {
+        threads.push_back(thread([&, i]() {
+          cells[i] = new OctTreeNode(items[i], level+1, boxes[i]);
+        }));
+      }
+    }
+    for (thread& t : threads)
+      t.join();
+  }
+  else {
     for (int i = 0; i < 8; i++) {
-      if (boxes[i].intersects(obj->position))
-        items[i].push_back(obj);
+      if (items[i].size() > 0)
+        cells[i] = new OctTreeNode(items[i], level+1, boxes[i]);
     }
   }
 
+  sumAggregate();
+}
+
+void OctTreeNode::sumAggregate () {
+  aggregate = OctreeAggregate();
+  glm::vec3 weighted;
+
+  auto add = [&](const OctreeAggregate& part) {
+    aggregate.count += part.count;
+    aggregate.mass += part.mass;
+    aggregate.velocitySum += part.velocitySum;
+    weighted += part.mass * part.centroid;
+  };
+
+  for (RigidBody *object : objects)
+    add(OctreeAggregate(object));
   for (int i = 0; i < 8; i++) {
-    if (items[i].size() > 0)
-      cells[i] = new OctTreeNode(items[i], level+1, boxes[i]);
+    if (cells[i] != NULL)
+      add(cells[i]->aggregate);
   }
+
+  // Massless groups fall back to the middle of the cell.
+  if (aggregate.mass > 0.0f)
+    aggregate.centroid = weighted / aggregate.mass;
+  else
+    aggregate.centroid = 0.5f * (box.minVals + box.maxVals);
 }
 
 vector<const OctTreeNode*> OctTreeNode::getAllNodes () const {
   vector<const OctTreeNode*> result;
   result.push_back(this);
 
-  for (int i = 0; i < 8; i++) {
-    if (this->cells[i] != NULL) {
-      for (const OctTreeNode *child : this->cells[i]->getAllNodes())
-        result.push_back(child);
+  // Children are appended behind their parent, so one pass reaches all.
+  for (int i = 0; i < result.size(); i++) {
+    for (int j = 0; j < 8; j++) {
+      if (result[i]->cells[j] != NULL)
+        result.push_back(result[i]->cells[j]);
     }
   }
 
   return result;
 }
 
+void OctTreeNode::getAllBoxes (vector<BoundingBox>& allBoxes) const {
+  allBoxes.push_back(box);
+  for (int i = 0; i < 8; i++) {
+    if (this->cells[i] != NULL)
+      this->cells[i]->getAllBoxes(allBoxes);
+  }
+}
+
+namespace {
+
+void addStats (const OctTreeNode* node, int depth, TreeStats& stats) {
+  vector<const OctTreeNode*> children;
+  for (int i = 0; i < 8; i++) {
+    if (node->cells[i] != NULL)
+      children.push_back(node->cells[i]);
+  }
+
+  size_t bytes = sizeof(OctTreeNode) +
+                 node->objects.capacity() * sizeof(RigidBody*);
+  stats.addNode(depth, node->box, children.empty(), node->objects.size(),
+                bytes);
+
+  for (int i = 0; i < children.size(); i++) {
+    for (int j = i + 1; j < children.size(); j++)
+      stats.addSiblings(children[i]->box, children[j]->box);
+    addStats(children[i], depth + 1, stats);
+  }
+}
+
+} // End anonymous namespace for statistics helper.
+
+TreeStats OctTreeNode::getStats () const {
+  TreeStats stats;
+  addStats(this, 0, stats);
+  stats.finish(box);
+  return stats;
+}
+
+namespace {
+
+typedef pair<float, RigidBody*> Neighbor;
+
+bool closer (const Neighbor& a, const Neighbor& b) {
+  return a.first < b.first;
+}
+
+} // End anonymous namespace for neighbour helpers.
+
+int OctTreeNode::getNearestNeighbors (const glm::vec3& point, int k,
+                                      NeighborBuffer& buffer,
+                                      const RigidBody* exclude) const {
+  vector<Neighbor>& heap = buffer.results;
+  heap.clear();
+  if (k <= 0)
+    return 0;
+
+  pair<float, const OctTreeNode*> stack[OCTREE_QUERY_STACK_SIZE];
+  int top = 0;
+  stack[top++] = make_pair(box.getDistance2(point), this);
+
+  while (top > 0) {
+    float nodeDist2 = stack[top - 1].first;
+    const OctTreeNode* node = stack[--top].second;
+
+    if (heap.size() == k && nodeDist2 >= heap.front().first)
+      continue;
+
+    for (RigidBody* object : node->objects) {
+      if (object == exclude)
+        continue;
+
+      glm::vec3 d = object->position - point;
+      float dist2 = glm::dot(d, d);
+      if (heap.size() == k && dist2 >= heap.front().first)
+        continue;
+
+      if (heap.size() == k) {
+        pop_heap(heap.begin(), heap.end(), closer);
+        heap.pop_back();
+      }
+      heap.push_back(make_pair(dist2, object));
+      push_heap(heap.begin(), heap.end(), closer);
+    }
+
+    // Push the children farthest first so the nearest is opened next.
+    pair<float, const OctTreeNode*> children[8];
+    int count = 0;
+    for (int i = 0; i < 8; i++) {
+      if (node->cells[i] == NULL)
+        continue;
+
+      pair<float, const OctTreeNode*> child(
+          node->cells[i]->box.getDistance2(point), node->cells[i]);
+      int j = count++;
+      for (; j > 0 && children[j - 1].first < child.first; j--)
+        children[j] = children[j - 1];
+      children[j] = child;
+    }
+
+    assert(top + count <= OCTREE_QUERY_STACK_SIZE);
+    for (int i = 0; i < count; i++)
+      stack[top++] = children[i];
+  }
+
+  sort_heap(heap.begin(), heap.end(), closer);
+  return heap.size();
+}
+
+int OctTreeNode::getNeighborsInRadius (const glm::vec3& center, float radius,
+                                       NeighborBuffer& buffer,
+                                       const RigidBody* exclude) const {
+  buffer.results.clear();
+  querySphere(center, radius, [&](RigidBody* object) {
+    if (object != exclude) {
+      glm::vec3 d = object->position - center;
+      buffer.results.push_back(make_pair(glm::dot(d, d), object));
+    }
+  });
+  return buffer.results.size();
+}
+
 bool OctTreeNode::isLeaf () const {
   return (this->objects.size() > 0);
 }
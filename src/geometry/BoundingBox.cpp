@@ -44,6 +44,29 @@ float BoundingBox::getSurfaceArea () const {
   return sa;
 }
 
+vec3 BoundingBox::getCenter () const {
+  return 0.5f * (minVals + maxVals);
+}
+
+int BoundingBox::getLongestAxis () const {
+  int axis = 0;
+  for (int i = 1; i < 3; ++i) {
+    if (maxVals[i] - minVals[i] > maxVals[axis] - minVals[axis])
+      axis = i;
+  }
+  return axis;
+}
+
+float BoundingBox::getDistance2 (const vec3& point) const {
+  float dist2 = 0.0f;
+  for (int i = 0; i < 3; ++i) {
+    float d = std::max(minVals[i] - point[i], 0.0f) +
+              std::max(point[i] - maxVals[i], 0.0f);
+    dist2 += d * d;
+  }
+  return dist2;
+}
+
 vector<vec4> BoundingBox::getVertices () const {
   vector<vec4> vertices;
 
@@ -81,6 +104,14 @@ vector<uvec2> BoundingBox::getEdges () const {
   return edges;
 }
 
+bool BoundingBox::contains (const BoundingBox& rhs) const {
+  for (int i = 0; i < 3; ++i) {
+    if (rhs.minVals[i] < minVals[i] || rhs.maxVals[i] > maxVals[i])
+      return false;
+  }
+  return true;
+}
+
 bool BoundingBox::intersects (const BoundingBox &rhs) const {
   return 
     (rhs.minVals[0] - 1e-5 <= maxVals[0]) && (rhs.maxVals[0] + 1e-5 >= minVals[0]) &&
@@ -99,31 +130,17 @@ bool BoundingBox::intersects (const vec3& point) const {
 }
 
 bool BoundingBox::intersects (const Ray& r, Intersection& isect) const {
-  vec3 R0 = r.position;
-  vec3 Rd = r.direction;
-  double tMin = -1.0e308;
-  double tMax = 1.0e308;
+  float tMin = -INF;
+  float tMax = INF;
   for (int currentaxis = 0; currentaxis < 3; currentaxis++) {
-    double vd = Rd[currentaxis];
-    if (vd == 0.0)
-      continue;
-    double v1 = minVals[currentaxis] - R0[currentaxis];
-    double v2 = maxVals[currentaxis] - R0[currentaxis];
-    // two slab intersections
-    double t1 = v1 / vd;
-    double t2 = v2 / vd;
-    if (t1 > t2) {
-      double ttemp = t1;
-      t1 = t2;
-      t2 = ttemp;
-    }
-    if (t1 > tMin) tMin = t1;
-    if (t2 < tMax) tMax = t2;
-    cout << tMin << " " << tMax << endl;
-    if (tMin > tMax) return false; // box is missed
-    if (tMax < 1e-5) return false; // box is behind ray
+    // two slab intersections, infinite when parallel to the slab
+    float t1 = (minVals[currentaxis] - r.position[currentaxis]) * r.invDirection[currentaxis];
+    float t2 = (maxVals[currentaxis] - r.position[currentaxis]) * r.invDirection[currentaxis];
+    tMin = std::max(tMin, std::min(t1, t2));
+    tMax = std::min(tMax, std::max(t1, t2));
   }
-  cout << "sucess" << endl;
+  if (tMin > tMax) return false; // box is missed
+  if (tMax < 1e-5) return false; // box is behind ray
   isect.timeHit = tMin;
   return true; // it made it past all 3 axes.
 }
@@ -10,6 +10,15 @@
 
 using namespace std;
 
+glm::vec3 Sphere::closestPoint (const glm::vec3& p) const {
+  glm::vec3 offset = p - position;
+  float length = glm::length(offset);
+  // Every surface point is equally close to the centre.
+  if (length == 0.0f)
+    return position + glm::vec3(radius, 0.0f, 0.0f);
+  return position + offset * float(radius / length);
+}
+
 bool Sphere::intersects (const Sphere& other, Intersection& isect) const {
   glm::vec3 normal = other.position - position;
 
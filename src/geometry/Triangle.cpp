@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <cmath>
 
+#include "geometry/Distance.h"
 #include "geometry/Triangle.h"
 #include "helpers/RandomUtils.h"
 
@@ -18,6 +19,10 @@ BoundingBox Triangle::getBoundingBox () const {
   return box;
 }
 
+vec3 Triangle::closestPoint (const vec3& p) const {
+  return closestPointOnTriangle(p, points[0], points[1], points[2]);
+}
+
 bool Triangle::intersects (const Ray& ray, Intersection& isect) const {
   const vec3 &o = ray.position;
   const vec3 &v = ray.direction;
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "helpers/Morton.h"
+#include "helpers/Parallel.h"
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Inserts two zero bits after each of the low 10 bits.
+uint32_t expandBits10 (uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// Inserts two zero bits after each of the low 21 bits.
+uint64_t expandBits21 (uint64_t v) {
+  v &= 0x1FFFFFull;
+  v = (v | v << 32) & 0x1F00000000FFFFull;
+  v = (v | v << 16) & 0x1F0000FF0000FFull;
+  v = (v | v << 8) & 0x100F00F00F00F00Full;
+  v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+  v = (v | v << 2) & 0x1249249249249249ull;
+  return v;
+}
+
+// Inverse of expandBits21, keeps every third bit.
+uint64_t compactBits21 (uint64_t v) {
+  v &= 0x1249249249249249ull;
+  v = (v ^ (v >> 2)) & 0x10C30C30C30C30C3ull;
+  v = (v ^ (v >> 4)) & 0x100F00F00F00F00Full;
+  v = (v ^ (v >> 8)) & 0x1F0000FF0000FFull;
+  v = (v ^ (v >> 16)) & 0x1F00000000FFFFull;
+  v = (v ^ (v >> 32)) & 0x1FFFFFull;
+  return v;
+}
+
+uint32_t quantize (float x, float cells) {
+  return static_cast<uint32_t>(std::min(std::max(x * cells, 0.0f), cells - 1.0f));
+}
+
+} // End anonymous namespace for bit interleaving.
+
+uint32_t getMortonCode30 (const vec3& p) {
+  const float cells = 1024.0f;
+  return (expandBits10(quantize(p.x, cells)) << 2) |
+         (expandBits10(quantize(p.y, cells)) << 1) |
+          expandBits10(quantize(p.z, cells));
+}
+
+uint64_t getMortonCode63 (const vec3& p) {
+  const float cells = 2097152.0f;
+  return encodeMorton63(uvec3(quantize(p.x, cells), quantize(p.y, cells),
+                              quantize(p.z, cells)));
+}
+
+uint64_t encodeMorton63 (const uvec3& cell) {
+  return (expandBits21(cell.x) << 2) |
+         (expandBits21(cell.y) << 1) |
+          expandBits21(cell.z);
+}
+
+uvec3 decodeMorton63 (uint64_t code) {
+  return uvec3(compactBits21(code >> 2), compactBits21(code >> 1),
+               compactBits21(code));
+}
+
+void parallelRadixSort (vector<uint64_t>& keys, vector<int>& values,
+                        int keyBits) {
+  int n = keys.size();
+  int numChunks = getNumChunks(n);
+
+  vector<uint64_t> keysTmp(n);
+  vector<int> valuesTmp(n);
+  vector<int> offsets(numChunks * RADIX_SIZE);
+
+  for (int shift = 0; shift < keyBits; shift += RADIX_BITS) {
+    fill(offsets.begin(), offsets.end(), 0);
+
+    // Each chunk counts its own digits.
+    parallelForChunks(numChunks, 0, n, [&](int c, int b, int e) {
+      int* histogram = &offsets[c * RADIX_SIZE];
+      for (int i = b; i < e; ++i)
+        histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+    });
+
+    // Digit major, chunk minor prefix sum keeps the sort stable.
+    int sum = 0;
+    for (int digit = 0; digit < RADIX_SIZE; ++digit) {
+      for (int c = 0; c < numChunks; ++c) {
+        int count = offsets[c * RADIX_SIZE + digit];
+        offsets[c * RADIX_SIZE + digit] = sum;
+        sum += count;
+      }
+    }
+
+    parallelForChunks(numChunks, 0, n, [&](int c, int b, int e) {
+      int* offset = &offsets[c * RADIX_SIZE];
+      for (int i = b; i < e; ++i) {
+        int dst = offset[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+        keysTmp[dst] = keys[i];
+        valuesTmp[dst] = values[i];
+      }
+    });
+
+    keys.swap(keysTmp);
+    values.swap(valuesTmp);
+  }
+}
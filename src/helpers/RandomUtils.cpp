@@ -10,8 +10,7 @@
 #include <glm/gtx/rotate_vector.hpp>                              // scale
 #include <glm/gtx/string_cast.hpp>                                // to_string
 
-#include "data_structures/BVH.h"
-#include "geometry/Triangle.h"
+#include "data_structures/MeshBVH.h"
 
 using namespace std;
 using namespace glm;
@@ -193,25 +192,10 @@ void fixDuplicateVertices (vector<vec4>& vertices, vector<uvec3>& faces) {
   faces = f;
 }
 
-namespace {
-
-vector<Triangle> getTrianglesFromMesh (const vector<vec4>& vertices,
-                                       const vector<uvec3>& faces) {
-  vector<Triangle> triangles;
-  for (const uvec3& face : faces) {
-    const vec4& a = vertices[face[0]];
-    const vec4& b = vertices[face[1]];
-    const vec4& c = vertices[face[2]];
-    triangles.push_back(Triangle(vec3(a), vec3(b), vec3(c)));
-  }
-  return triangles;
-}
-
-} // End anonymous namespace for fix normals helper functions.
-
 void fixNormals (const vector<vec4>& vertices, vector<uvec3>& faces) {
-  vector<Triangle> triangles = getTrianglesFromMesh(vertices, faces);
+  MeshBVH bvh(vertices, faces);
   size_t normals_swapped = 0;
+  vector<MeshHit> hits;
 
   for (uvec3& face : faces) {
     const vec4& a = vertices[face[0]];
@@ -221,16 +205,13 @@ void fixNormals (const vector<vec4>& vertices, vector<uvec3>& faces) {
     vec3 v = vec3(normalize(c - a));
     vec3 normal = cross(u, v);
 
-    int numberIntersection = 0;
-
     vec3 position = (a + b + c) / 3.0f;
     vec3 direction = normal;
     Ray ray(position + direction * 1e-7f, direction);
 
-    Intersection tmp;
-
-    for (const Triangle &tri : triangles)
-      numberIntersection += tri.intersects(ray, tmp);
+    // Crossing a shared edge hits both faces but is only one crossing.
+    hits.clear();
+    int numberIntersection = bvh.getAllIntersections(ray, hits, true, true);
 
     if (numberIntersection % 2 != 0) {
       int x = face[0];
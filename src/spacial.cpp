@@ -5,7 +5,9 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
-#include "data_structures/BVH.h"
+#include "data_structures/InstanceBVH.h"
+#include "data_structures/LinearBVH.h"
+#include "data_structures/MeshBVH.h"
 #include "data_structures/octree.h"
 #include "geometry/Geometry.h"
 #include "geometry/Triangle.h"
@@ -44,7 +46,11 @@ vector<RigidBody*> bunny_octtree_mesh;
 vector<RigidBody*> bunny_bvh_mesh;
 
 OctTreeNode *octtree;
-BVHNode *bvh;
+LinearBVH *bvh;
+
+// Both bunny placements share one mesh BVH.
+MeshBVH *bunny_bvh;
+InstanceBVH bunny_instances;
 
 void setupModels () {
   for (const vec4 &vertex : bunny_vertices) {
@@ -53,7 +59,12 @@ void setupModels () {
   }
 
   octtree = new OctTreeNode(bunny_octtree_mesh);
-  bvh = new BVHNode(bunny_bvh_mesh);
+  bvh = new LinearBVH(bunny_bvh_mesh);
+
+  bunny_bvh = new MeshBVH(bunny_vertices, bunny_faces);
+  bunny_instances.addInstance(bunny_bvh, POSITION_A);
+  bunny_instances.addInstance(bunny_bvh, POSITION_B);
+  bunny_instances.build();
 }
 
 void setupOpenGL () {
@@ -94,8 +105,23 @@ int main (int argc, char* argv[]) {
         lineP.drawBoundingBox(node->box, BLUE);
     }
 
+    // Picks the bunny in the middle of the view, rays only walk the mesh
+    // BVH of instances whose boxes they reach.
+    InstanceHit hit;
+    bunny_instances.getIntersection(Ray(eye, center - eye), hit);
+
+    for (int i = 0; i < bunny_instances.instances.size(); ++i) {
+      bool picked = hit.hit && hit.instance == i;
+      lineP.drawBoundingBox(bunny_instances.instances[i].box,
+                            picked ? GREEN : CYAN);
+    }
+
     endLoopOpenGL();
   }
 
+  delete octtree;
+  delete bvh;
+  delete bunny_bvh;
+
   cleanupOpenGL();
 }